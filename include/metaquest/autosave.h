@@ -0,0 +1,243 @@
+/**\file
+ * \brief Autosave
+ *
+ * Saves the game periodically, on a background thread, so that a crash
+ * doesn't lose a whole session and the game never has to wait for the disk.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_AUTOSAVE_H)
+#define METAQUEST_AUTOSAVE_H
+
+#include <metaquest/save-binary.h>
+#include <metaquest/save-json.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace metaquest {
+namespace save {
+/**\brief Save to a file
+ *
+ * Writes save data to a temporary file next to the target, syncs it to disk
+ * and then renames it over the target, so the file either has the old or the
+ * new data, but never a partial save. The directory is synced after the
+ * rename, so that the rename itself survives a crash.
+ *
+ * \param[in] file   The file to save to.
+ * \param[in] format "json" to save as JSON, binary otherwise.
+ * \param[in] data   What to save; anything with a write(save::writer&).
+ *
+ * \returns 'true' if the save was written successfully.
+ */
+template <typename T>
+static bool store(const std::string &file, const std::string &format,
+                  const T &data) {
+  const std::string temp = file + ".tmp";
+  const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  bool ok;
+
+  {
+    output out(fd);
+    std::unique_ptr<writer> w;
+
+    if (format == "json") {
+      w.reset(new json::writer(out));
+    } else {
+      w.reset(new binary::writer(out));
+    }
+
+    data.write(*w);
+
+    ok = out.flush();
+  }
+
+  ok = (::fsync(fd) == 0) && ok;
+  ok = (::close(fd) == 0) && ok;
+
+  if (ok) {
+    ok = std::rename(temp.c_str(), file.c_str()) == 0;
+  }
+
+  if (!ok) {
+    std::remove(temp.c_str());
+    return false;
+  }
+
+  const auto slash = file.rfind('/');
+  const std::string directory =
+      slash == std::string::npos ? "." : file.substr(0, slash ? slash : 1);
+  const int dfd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dfd < 0) {
+    return false;
+  }
+
+  ok = (::fsync(dfd) == 0);
+  ok = (::close(dfd) == 0) && ok;
+
+  return ok;
+}
+
+/**\brief Background autosave
+ *
+ * Takes snapshots of the game state - which should be cheap to take on the
+ * game's thread - and stores them on a thread of its own. By default only the
+ * most recent snapshot is kept; if the writer falls behind, older ones are
+ * simply replaced. Snapshots that only make sense together, such as journal
+ * updates, can be queued up instead.
+ *
+ * \tparam snapshot The snapshot type.
+ */
+template <typename snapshot> class autosave {
+public:
+  /**\brief Function that stores a snapshot
+   *
+   * Called on the autosave thread; returns 'true' on success.
+   */
+  using storage = std::function<bool(const snapshot &)>;
+
+  /**\brief Construct with storage function and interval
+   *
+   * \param[in] pStore    Stores snapshots.
+   * \param[in] pInterval How often to save.
+   * \param[in] pQueue    Write every snapshot, instead of just the latest.
+   */
+  autosave(storage pStore, std::chrono::seconds pInterval,
+           bool pQueue = false)
+      : store(pStore), interval(pInterval), queue(pQueue),
+        next(std::chrono::steady_clock::now() + pInterval), alive(true),
+        failed(false), thread(&autosave::run, this) {}
+
+  /**\brief Construct with file and interval
+   *
+   * Stores snapshots with save::store(), so the snapshot type needs a
+   * write(save::writer&) method.
+   *
+   * \param[in] pFile     The file to save to.
+   * \param[in] pFormat   The save format, as for store().
+   * \param[in] pInterval How often to save.
+   */
+  autosave(const std::string &pFile, const std::string &pFormat,
+           std::chrono::seconds pInterval)
+      : autosave(
+            [pFile, pFormat](const snapshot &s) -> bool {
+              return save::store(pFile, pFormat, s);
+            },
+            pInterval) {}
+
+  /**\brief Destructor
+   *
+   * Writes any snapshots that are still pending and waits for the thread to
+   * finish.
+   */
+  ~autosave(void) { finish(); }
+
+  /**\brief Stop saving
+   *
+   * Writes any snapshots that are still pending and waits for the thread to
+   * finish, so error() is final afterwards. No more snapshots are written
+   * after this.
+   */
+  void finish(void) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      alive = false;
+    }
+    ready.notify_one();
+
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  /**\brief Is a new snapshot due?
+   *
+   * \returns 'true' if the save interval has passed since the last offer().
+   */
+  bool due(void) const { return std::chrono::steady_clock::now() >= next; }
+
+  /**\brief Hand over a snapshot
+   *
+   * Queues the snapshot to be written and restarts the save interval. Unless
+   * the autosave was set up to queue snapshots, this replaces any snapshot
+   * that hasn't been written yet. Never waits for I/O.
+   *
+   * \param[in] s The snapshot to save.
+   */
+  void offer(snapshot &&s) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!queue) {
+        pending.clear();
+      }
+      pending.push_back(std::move(s));
+    }
+    next = std::chrono::steady_clock::now() + interval;
+    ready.notify_one();
+  }
+
+  /**\brief Did any save fail?
+   *
+   * \returns 'true' if writing any of the snapshots failed.
+   */
+  bool error(void) const { return failed; }
+
+protected:
+  const storage store;
+  const std::chrono::seconds interval;
+  const bool queue;
+  std::chrono::steady_clock::time_point next;
+
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<snapshot> pending;
+  bool alive;
+  std::atomic<bool> failed;
+  std::thread thread;
+
+  void run(void) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+      ready.wait(lock, [this] { return !pending.empty() || !alive; });
+
+      if (!pending.empty()) {
+        snapshot s = std::move(pending.front());
+        pending.pop_front();
+
+        lock.unlock();
+        if (!store(s)) {
+          failed = true;
+        }
+        lock.lock();
+      } else if (!alive) {
+        return;
+      }
+    }
+  }
+};
+}
+}
+
+#endif
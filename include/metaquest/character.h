@@ -132,7 +132,7 @@ public:
   virtual const slots<T> usedSlots(void) const {
     slots<T> s = {};
     for (auto &item : equipment) {
-      for (auto &sl : item.usedSlots) {
+      for (auto &sl : item.type->usedSlots) {
         s[sl.first] += sl.second;
       }
     }
@@ -153,6 +153,7 @@ public:
     equipment.load(json("equipment"));
     inventory.load(json("inventory"));
 
+    parent::touch();
     return true;
   }
 
@@ -166,6 +167,27 @@ public:
   }
 
   std::vector<std::string> actions;
+
+protected:
+  virtual void fields(save::writer &out) const {
+    parent::fields(out);
+
+    out.key("equipment");
+    equipment.write(out);
+
+    out.key("inventory");
+    inventory.write(out);
+  }
+
+  virtual bool field(const std::string &key, save::reader &in) {
+    if (key == "equipment") {
+      return equipment.read(in);
+    } else if (key == "inventory") {
+      return inventory.read(in);
+    }
+
+    return parent::field(key, in);
+  }
 };
 }
 
@@ -0,0 +1,120 @@
+/**\file
+ * \brief Fibers
+ *
+ * Lets code that is written to wait for something - such as a game that asks
+ * the player a question and waits for the answer - run without a thread of
+ * its own: it runs on a stack of its own instead, and hands control back to
+ * whoever resumed it whenever it would wait.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_FIBER_H)
+#define METAQUEST_FIBER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <ucontext.h>
+
+namespace metaquest {
+/**\brief Fiber
+ *
+ * Runs a function on a stack of its own. The function runs in resume(), on
+ * the calling thread, until it calls yield() or returns; the next resume()
+ * picks up where it left off. Fibers never run by themselves, so they only
+ * need to be guarded the way their resume() calls are, e.g. by resuming them
+ * on an asio strand.
+ *
+ * Uses the POSIX ucontext functions. Exceptions must not leave the function,
+ * and as a fiber may be resumed on another thread than the one it yielded on,
+ * it must not hold on to thread-local variables across yield().
+ */
+class fiber {
+public:
+  /**\brief Construct with function and stack size
+   *
+   * \param[in] pBody  The function to run.
+   * \param[in] pStack Size of the fiber's stack, in bytes; pages of it that
+   *                   are never used usually don't take up any memory.
+   */
+  fiber(std::function<void(void)> pBody, std::size_t pStack = 256 * 1024)
+      : body(pBody), stack(new char[pStack]), size(pStack), started(false),
+        finished(false) {}
+
+  fiber(const fiber &) = delete;
+  fiber &operator=(const fiber &) = delete;
+
+  /**\brief Run the fiber
+   *
+   * Runs the fiber's function until it yields or returns.
+   *
+   * \returns 'true' if the fiber yielded, and can be resumed again.
+   */
+  bool resume(void) {
+    if (finished) {
+      return false;
+    }
+
+    if (!started) {
+      const std::uint64_t self = std::uintptr_t(this);
+
+      ::getcontext(&context);
+      context.uc_stack.ss_sp = stack.get();
+      context.uc_stack.ss_size = size;
+      context.uc_link = &caller;
+
+      // makecontext() only passes ints, so the pointer is passed in halves
+      ::makecontext(&context, (void (*)(void))entry, 2,
+                    (unsigned int)(self >> 32), (unsigned int)self);
+
+      started = true;
+    }
+
+    ::swapcontext(&caller, &context);
+
+    return !finished;
+  }
+
+  /**\brief Hand back control
+   *
+   * Called on the fiber, returns from the resume() that ran it; returns
+   * itself when the fiber is resumed again.
+   */
+  void yield(void) { ::swapcontext(&context, &caller); }
+
+  /**\brief Has the function returned? */
+  bool done(void) const { return finished; }
+
+protected:
+  std::function<void(void)> body;
+  std::unique_ptr<char[]> stack;
+  const std::size_t size;
+  bool started;
+  bool finished;
+
+  /**\brief The fiber's context, as of its last yield(). */
+  ucontext_t context;
+
+  /**\brief The context of the last resume(). */
+  ucontext_t caller;
+
+  static void entry(unsigned int high, unsigned int low) {
+    fiber &f = *(fiber *)std::uintptr_t((std::uint64_t(high) << 32) | low);
+
+    f.body();
+    f.finished = true;
+
+    // returning continues with uc_link, i.e. the last resume()
+  }
+};
+}
+
+#endif
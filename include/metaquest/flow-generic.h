@@ -15,6 +15,10 @@
 #if !defined(METAQUEST_FLOW_GENERIC_H)
 #define METAQUEST_FLOW_GENERIC_H
 
+#include <metaquest/save.h>
+
+#include <functional>
+
 namespace metaquest {
 namespace flow {
 template <typename interaction, typename logic> class generic {
@@ -23,6 +27,10 @@ public:
 
   bool run(void) {
     while (true) {
+      if (checkpoint) {
+        checkpoint(*this);
+      }
+
       interact.drawUI(game);
 
       switch (game.state()) {
@@ -63,8 +71,63 @@ public:
     return rv;
   }
 
+  bool read(save::reader &in) {
+    std::string k;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    while (in.key(k)) {
+      if (k == "game") {
+        game.read(in);
+      } else if (k == "interaction") {
+        interact.read(in);
+      } else {
+        in.skip();
+      }
+    }
+
+    return in.good();
+  }
+
+  void write(save::writer &out) const { write(out, game, interact); }
+
+  /**\brief Saved game and interaction state.
+   *
+   * Taken by capture(), and written out in the same format as write().
+   */
+  class snapshot {
+  public:
+    typename logic::snapshot game;
+    typename interaction::snapshot interact;
+
+    void write(save::writer &out) const { generic::write(out, game, interact); }
+  };
+
+  snapshot capture(void) const { return {game.capture(), interact.capture()}; }
+
   interaction interact;
   logic game;
+
+  /**\brief Checkpoint hook
+   *
+   * Called by run() after every step of the game, when the game state is
+   * consistent; e.g. to hand a snapshot to an autosave. The hook may take
+   * entries that were moved out of the logbook, to write them elsewhere.
+   */
+  std::function<void(generic &)> checkpoint;
+
+protected:
+  template <typename G, typename I>
+  static void write(save::writer &out, const G &game, const I &interact) {
+    out.beginObject();
+    out.key("game");
+    game.write(out);
+    out.key("interaction");
+    interact.write(out);
+    out.end();
+  }
 };
 }
 }
@@ -14,6 +14,7 @@
 
 #include <metaquest/character.h>
 #include <metaquest/party.h>
+#include <array>
 #include <random>
 #include <algorithm>
 #include <iterator>
@@ -39,6 +40,13 @@ public:
 
   enum state { menu, combat, victory, defeat, exit };
 
+  /**\brief End the game
+   *
+   * Makes state() return 'exit' from now on, as when the player quits; e.g.
+   * to stop a game from the outside.
+   */
+  void end(void) { willExit = true; }
+
   virtual enum state state(void) const {
     if (willExit) {
       return exit;
@@ -221,13 +229,13 @@ public:
 
     std::set<std::string> se;
 
-    se.insert(i.name.display());
+    se.insert(std::string(i.name.display()));
 
-    for (auto &slot : i.usedSlots) {
+    for (auto &slot : i.type->usedSlots) {
       for (auto &item : p.inventory) {
-        auto slots = item.usedSlots;
+        auto slots = item.usedSlots();
         if (slots[slot.first] > 0) {
-          se.insert(item.name.display());
+          se.insert(std::string(item.name.display()));
         }
       }
     }
@@ -257,6 +265,8 @@ public:
       }
     }
 
+    c.touch();
+    p.inventory.touch();
     retry = false;
 
     return "Item swapped.";
@@ -272,9 +282,9 @@ public:
     std::set<std::string> se;
 
     for (auto &item : p.inventory) {
-      auto slots = item.usedSlots;
+      auto slots = item.usedSlots();
       if (slots[s] > 0) {
-        se.insert(item.name.display());
+        se.insert(std::string(item.name.display()));
       }
     }
 
@@ -294,6 +304,8 @@ public:
       }
     }
 
+    c.touch();
+    p.inventory.touch();
     retry = false;
 
     return "Item equipped.";
@@ -303,10 +315,12 @@ public:
     retry = true;
 
     std::vector<std::string> slots;
+    std::string label;
 
     for (const auto &item : o.equipment) {
-      for (const auto &slot : item.usedSlots) {
-        slots.push_back(slot.first + ": " + item.name.display());
+      for (const auto &slot : item.type->usedSlots) {
+        label.assign(slot.first).append(": ").append(item.name.display());
+        slots.push_back(label);
       }
     }
 
@@ -319,8 +333,9 @@ public:
     std::string sl = interact.query(*this, o, slots, 8);
 
     for (const auto &item : o.equipment) {
-      for (const auto &slot : item.usedSlots) {
-        if ((slot.first + ": " + item.name.display()) == sl) {
+      for (const auto &slot : item.type->usedSlots) {
+        label.assign(slot.first).append(": ").append(item.name.display());
+        if (label == sl) {
           return equip(retry, o, item);
         }
       }
@@ -359,9 +374,9 @@ public:
     }
 
     for (const auto &item : c.equipment) {
-      for (const auto &slot : item.usedSlots) {
-        data[slot.first] +=
-            (data[slot.first] != "" ? ", " : "") + item.name.display();
+      for (const auto &slot : item.type->usedSlots) {
+        data[slot.first] += (data[slot.first] != "" ? ", " : "");
+        data[slot.first] += item.name.display();
       }
     }
 
@@ -525,6 +540,16 @@ public:
 
   virtual character generateCharacter(long points = 0) = 0;
 
+  /**\brief Create a blank character.
+   *
+   * Creates a character that has the rule set's functions and actions, but
+   * none of the randomly generated parts; used when loading characters from
+   * save data, which then fills in everything else.
+   *
+   * \returns A character with no name, attributes or items.
+   */
+  virtual character blankCharacter(void) { return character(); }
+
   /**\brief Generate a party.
    *
    * Given the number of members you want the party to consist of, this will
@@ -586,11 +611,72 @@ public:
     return rv;
   }
 
+  virtual bool read(save::reader &in) {
+    std::string k;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    parties.clear();
+
+    while (in.key(k)) {
+      if (k == "turn") {
+        in.number(turn);
+      } else if (k == "parties") {
+        in.beginArray();
+        while (in.next()) {
+          parties.push_back(party::read(*this, in));
+        }
+      } else {
+        in.skip();
+      }
+    }
+
+    if (!in.good()) {
+      return false;
+    }
+
+    if (parties.size() > 0) {
+      nParties = parties.size();
+    }
+
+    generateParties();
+
+    return true;
+  }
+
+  virtual void write(save::writer &out) const {
+    write(out, parties, turnPositions(), turn);
+  }
+
+  /**\brief Saved game state.
+   *
+   * A copy of everything that write() saves, so that it can be written out
+   * later - e.g. on another thread - while the game goes on.
+   */
+  class snapshot {
+  public:
+    std::vector<party> parties;
+    std::vector<std::array<size_t, 2>> turnOrder;
+    num turn;
+
+    void write(save::writer &out) const {
+      base::write(out, parties, turnOrder, turn);
+    }
+  };
+
+  /**\brief Take a snapshot.
+   *
+   * \returns A copy of the current game state, for saving.
+   */
+  snapshot capture(void) const { return {parties, turnPositions(), turn}; }
+
   virtual std::string call(const std::string &skill, character &c,
                            std::vector<character *> &pTarget) {
     auto act = characterAction.find(skill);
     if (act == characterAction.end()) {
-      return c.name.display() + " looks bewildered";
+      return std::string(c.name.display()).append(" looks bewildered");
     }
 
     return call(act->second, c, pTarget);
@@ -600,7 +686,7 @@ public:
                            std::vector<character *> &pTarget) {
     auto &cost = action.cost;
     if (!cost.canApply(c)) {
-      return c.name.display() + " not enough resources";
+      return std::string(c.name.display()).append(" not enough resources");
     }
 
     objects source, target;
@@ -664,6 +750,49 @@ protected:
   std::vector<character *> currentTurnOrder;
   num nParties;
   num turn;
+
+  /**\brief Turn order by position.
+   *
+   * \returns The party and position of each character in the current turn
+   *          order.
+   */
+  std::vector<std::array<size_t, 2>> turnPositions(void) const {
+    std::vector<std::array<size_t, 2>> rv;
+
+    for (auto &to : currentTurnOrder) {
+      rv.push_back({partyOf(*to), positionOf(*to)});
+    }
+
+    return rv;
+  }
+
+  static void write(save::writer &out, const std::vector<party> &parties,
+                    const std::vector<std::array<size_t, 2>> &turnOrder,
+                    num turn) {
+    out.beginObject();
+
+    out.key("parties");
+    out.beginArray();
+    for (auto &party : parties) {
+      party.write(out);
+    }
+    out.end();
+
+    out.key("turn-order");
+    out.beginArray();
+    for (auto &to : turnOrder) {
+      out.beginArray();
+      out.number(to[0]);
+      out.number(to[1]);
+      out.end();
+    }
+    out.end();
+
+    out.key("turn");
+    out.number(turn);
+
+    out.end();
+  }
   std::map<std::string, action> characterAction;
 
   bool willExit;
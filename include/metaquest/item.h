@@ -18,54 +18,327 @@
 
 #include <metaquest/action.h>
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace metaquest {
 /**\brief An item
  *
- * Defines the basic interface that any item follows - turns out items are
- * your standard type of object. Who'da thunk?
+ * Defines the basic interface that any item follows. Items look a lot like
+ * any other object, but there are plenty of them and most of what they are
+ * is the same for every item of a kind; so they keep that in a shared kind,
+ * and only have their name and rolled attributes to themselves.
  *
  * \tparam T Base type for attributes. Integers are probably a good choice,
  *           at least for J-RPGs and tabletops.
  */
-template <typename T = long> class item : public object<T> {
+template <typename T = long> class item {
 public:
-  using parent = metaquest::object<T>;
+  /**\brief Item kind
+   *
+   * The properties that all items of the same kind have in common: all swords
+   * go in the weapon slot and have the same effect, they only differ in their
+   * rolled stats. Items refer to a shared, immutable instance of this class,
+   * so copying an item - e.g. when handing out loot - doesn't copy these.
+   */
+  class kind {
+  public:
+    /**\brief Base name of the item kind, e.g. "Sword". */
+    std::string name;
 
-  std::string effect;
-  slots<T> usedSlots;
+    /**\brief Effect string of the item kind. */
+    std::string effect;
 
-  virtual bool load(efgy::json::json json) {
-    parent::load(json);
+    /**\brief Slots that an item of this kind occupies when equipped. */
+    slots<T> usedSlots;
+
+    /**\brief Slots that an item of this kind adds when equipped. */
+    slots<T> addedSlots;
+
+    bool operator==(const kind &b) const {
+      return (name == b.name) && (effect == b.effect) &&
+             (usedSlots == b.usedSlots) && (addedSlots == b.addedSlots);
+    }
+
+    std::size_t hash(void) const {
+      std::size_t h = std::hash<std::string>()(name);
+
+      const auto mix = [&h](std::size_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+      };
+
+      mix(std::hash<std::string>()(effect));
+      for (const auto &s : usedSlots) {
+        mix(std::hash<std::string>()(s.first));
+        mix(std::hash<T>()(s.second));
+      }
+      for (const auto &s : addedSlots) {
+        mix(std::hash<std::string>()(s.first) + 1);
+        mix(std::hash<T>()(s.second));
+      }
+
+      return h;
+    }
+
+    /**\brief Look up a shared item kind
+     *
+     * Item kinds are interned, so that all items of the same kind share a
+     * single instance, regardless of whether they were generated or loaded.
+     *
+     * \param[in] k The item kind to look up.
+     *
+     * \returns A shared instance equal to the given kind.
+     */
+    static std::shared_ptr<const kind> get(const kind &k) {
+      static std::mutex mutex;
+      static std::unordered_multimap<std::size_t, std::shared_ptr<const kind>>
+          kinds;
+
+      const std::size_t h = k.hash();
+      std::lock_guard<std::mutex> lock(mutex);
+
+      const auto range = kinds.equal_range(h);
+      for (auto it = range.first; it != range.second; it++) {
+        if (*it->second == k) {
+          return it->second;
+        }
+      }
+
+      return kinds.emplace(h, std::make_shared<const kind>(k))->second;
+    }
+
+    /**\brief The kind of items that are nothing in particular. */
+    static const std::shared_ptr<const kind> &none(void) {
+      static const auto n = get({});
+      return n;
+    }
+  };
+
+  item(void) : type(kind::none()) {}
+
+  item(const std::shared_ptr<const kind> &pType) : type(pType) {}
+
+  /**\brief Kind of the item
+   *
+   * Shared properties of this item; only the name and rolled stats are
+   * stored with the item itself.
+   */
+  std::shared_ptr<const kind> type;
+
+  /**\brief Item name, e.g. "Sword +7". */
+  name::proper<> name;
+
+  /**\brief Rolled attributes */
+  std::map<std::string, T> attribute;
+
+  const std::string &effect(void) const { return type->effect; }
+
+  T operator[](const std::string &s) const {
+    const auto it = attribute.find(s);
+    return it != attribute.end() ? it->second : 0;
+  }
+
+  std::set<std::string> attributes(void) const {
+    std::set<std::string> ret;
+
+    for (const auto &m : attribute) {
+      ret.insert(m.first);
+    }
+
+    return ret;
+  }
+
+  const slots<T> &allSlots(void) const { return type->addedSlots; }
+
+  const slots<T> &usedSlots(void) const { return type->usedSlots; }
+
+  bool load(efgy::json::json json) {
+    kind k;
+
+    name.load(json("name"));
+
+    if (name.size() > 0) {
+      k.name = std::string(name.part(0));
+    }
+
+    attribute.clear();
+    for (const auto data : json("attributes").asObject()) {
+      attribute[data.first] = data.second.asNumber();
+    }
+
+    for (const auto data : json("slots").asObject()) {
+      k.addedSlots[data.first] = data.second.asNumber();
+    }
 
     for (const auto data : json("target-slots").asObject()) {
-      usedSlots[data.first] = data.second.asNumber();
+      k.usedSlots[data.first] = data.second.asNumber();
     }
 
-    effect = json("effect").asString();
+    k.effect = json("effect").asString();
+
+    type = kind::get(k);
 
     return true;
   }
 
-  virtual efgy::json::json json(void) const {
-    efgy::json::json rv = parent::json();
+  efgy::json::json json(void) const {
+    efgy::json::json rv;
 
-    auto &sl = rv("target-slots");
-    for (auto &slot : usedSlots) {
+    rv("name") = name.json();
+
+    auto &at = rv("attributes");
+    for (auto &attrib : attribute) {
+      at(attrib.first) = efgy::json::json::numeric(attrib.second);
+    }
+
+    auto &sl = rv("slots");
+    for (auto &slot : type->addedSlots) {
       sl(slot.first) = efgy::json::json::numeric(slot.second);
     }
 
-    rv("effect") = effect;
+    auto &ts = rv("target-slots");
+    for (auto &slot : type->usedSlots) {
+      ts(slot.first) = efgy::json::json::numeric(slot.second);
+    }
+
+    rv("effect") = type->effect;
 
     return rv;
   }
+
+  /**\brief Write to save data
+   *
+   * Writes the same members as an object would, followed by the item kind's.
+   *
+   * \param[out] out Where to write the item to.
+   */
+  void write(save::writer &out) const {
+    out.beginObject();
+
+    out.key("name");
+    name.write(out);
+
+    out.key("attributes");
+    out.beginObject();
+    for (auto &attrib : attribute) {
+      out.key(attrib.first);
+      out.number(attrib.second);
+    }
+    out.end();
+
+    out.key("slots");
+    writeSlots(out, type->addedSlots);
+
+    out.key("target-slots");
+    writeSlots(out, type->usedSlots);
+
+    out.key("effect");
+    out.string(type->effect);
+
+    out.end();
+  }
+
+  /**\brief Read from save data
+   *
+   * The item kind is read into a private copy, and only interned once the
+   * whole item has been read; the item is left alone if that fails.
+   *
+   * \param[in] in Where to read the item from.
+   *
+   * \returns 'true' if the item was read successfully.
+   */
+  bool read(save::reader &in) {
+    item i;
+    kind k;
+    std::string key, s;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    while (in.key(key)) {
+      if (key == "name") {
+        if (!i.name.read(in)) {
+          return false;
+        }
+      } else if (key == "attributes") {
+        in.beginObject();
+        while (in.key(s)) {
+          in.number(i.attribute[s]);
+        }
+      } else if (key == "slots") {
+        readSlots(in, k.addedSlots);
+      } else if (key == "target-slots") {
+        readSlots(in, k.usedSlots);
+      } else if (key == "effect") {
+        in.string(k.effect);
+      } else {
+        in.skip();
+      }
+
+      if (!in.good()) {
+        return false;
+      }
+    }
+
+    if (!in.good()) {
+      return false;
+    }
+
+    if (i.name.size() > 0) {
+      k.name = std::string(i.name.part(0));
+    }
+
+    i.type = kind::get(k);
+    *this = std::move(i);
+
+    return true;
+  }
+
+protected:
+  static void writeSlots(save::writer &out, const slots<T> &s) {
+    out.beginObject();
+    for (auto &slot : s) {
+      out.key(slot.first);
+      out.number(slot.second);
+    }
+    out.end();
+  }
+
+  static void readSlots(save::reader &in, slots<T> &s) {
+    std::string k;
+
+    in.beginObject();
+    while (in.key(k)) {
+      in.number(s[k]);
+    }
+  }
 };
 
+/**\brief A list of items
+ *
+ * Like the objects' revisions, the list's revision changes with load() and
+ * read(); code that adds or removes items needs to call touch().
+ */
 template <typename T> class items : public std::vector<item<T>> {
 public:
   using std::vector<item<T>>::vector;
 
+  /**\brief Revision of the list, as for object::revision(). */
+  std::uint64_t revision(void) const { return stamp; }
+
+  /**\brief Mark the list as changed. */
+  void touch(void) { stamp = revisions::next(); }
+
   virtual bool load(efgy::json::json json) {
     this->clear();
+    touch();
 
     for (const auto data : json.asArray()) {
       item<T> it;
@@ -86,6 +359,36 @@ public:
 
     return rv;
   }
+
+  void write(save::writer &out) const {
+    out.beginArray();
+    for (auto &it : *this) {
+      it.write(out);
+    }
+    out.end();
+  }
+
+  bool read(save::reader &in) {
+    this->clear();
+    touch();
+
+    if (!in.beginArray()) {
+      return false;
+    }
+
+    while (in.next()) {
+      item<T> it;
+      if (!it.read(in)) {
+        return false;
+      }
+      this->push_back(it);
+    }
+
+    return in.good();
+  }
+
+protected:
+  std::uint64_t stamp = revisions::next();
 };
 }
 
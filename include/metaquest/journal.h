@@ -0,0 +1,434 @@
+/**\file
+ * \brief Save journal
+ *
+ * Incremental saves: instead of writing the whole game every time, only the
+ * characters, inventories and log entries that changed since the previous
+ * save are appended to a journal next to the save file. The journal is
+ * replayed on top of the save when the game is loaded, and every so often it
+ * is compacted into a new full save.
+ *
+ * The journal is a sequence of binary saves, one per update. Each update is
+ * an object with the number of parties, a list of changes and the new log
+ * entries. Changes are objects with a "party" index, and then either a party
+ * "size", a "member" index and its "character", or an "inventory". Log
+ * entries come with the index of the first one, as "from".
+ *
+ * Updates also carry the log entries that were moved out of the logbook, so
+ * they're written to the logbook's segment files along with the update,
+ * rather than on the game's thread.
+ *
+ * All changes contain the full new state of what they describe, so replaying
+ * an update twice has the same effect as replaying it once. That's what makes
+ * it safe to compact the journal by appending a final update, storing the
+ * full save and only then removing the journal.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_JOURNAL_H)
+#define METAQUEST_JOURNAL_H
+
+#include <metaquest/autosave.h>
+#include <metaquest/logbook.h>
+#include <metaquest/mapping.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+namespace metaquest {
+namespace save {
+/**\brief Save journal
+ *
+ * Keeps track of what was last saved, so it can tell what changed, and
+ * appends the changes to the journal file.
+ *
+ * \tparam G The game flow type, e.g. flow::generic.
+ */
+template <typename G> class journal {
+public:
+  using game = decltype(G::game);
+  using party = typename game::party;
+  using character = typename game::character;
+  using items = decltype(party::inventory);
+
+  /**\brief Construct with save file
+   *
+   * \param[in] pFile    The save file; the journal is next to it.
+   * \param[in] pFormat  The format of full saves, as for store().
+   * \param[in] pCompact After how many updates to compact the journal.
+   */
+  journal(const std::string &pFile, const std::string &pFormat,
+          std::size_t pCompact = 64)
+      : file(pFile), path(pFile + ".journal"), format(pFormat),
+        compact(pCompact), count(0), log(0), broken(false) {}
+
+  /**\brief Changes since the last update
+   *
+   * Contains copies of everything that changed, so it can be written on
+   * another thread. When the journal is due to be compacted, it also contains
+   * a snapshot of the whole game.
+   */
+  class update {
+  public:
+    std::size_t parties;
+    std::vector<std::array<std::size_t, 2>> sizes;
+    std::vector<std::tuple<std::size_t, std::size_t, character>> members;
+    std::vector<std::pair<std::size_t, items>> inventories;
+    std::size_t from;
+    std::vector<logbook::entry> log;
+    std::optional<typename G::snapshot> full;
+
+    /**\brief Entries moved out of the logbook, for its segment files. */
+    logbook::batch archive;
+
+    bool empty(void) const {
+      return sizes.empty() && members.empty() && inventories.empty() &&
+             log.empty() && !full && archive.empty();
+    }
+
+    void write(save::writer &out) const {
+      out.beginObject();
+
+      out.key("parties");
+      out.number(parties);
+
+      out.key("changes");
+      out.beginArray();
+      for (auto &s : sizes) {
+        out.beginObject();
+        out.key("party");
+        out.number(s[0]);
+        out.key("size");
+        out.number(s[1]);
+        out.end();
+      }
+      for (auto &m : members) {
+        out.beginObject();
+        out.key("party");
+        out.number(std::get<0>(m));
+        out.key("member");
+        out.number(std::get<1>(m));
+        out.key("character");
+        std::get<2>(m).write(out);
+        out.end();
+      }
+      for (auto &i : inventories) {
+        out.beginObject();
+        out.key("party");
+        out.number(i.first);
+        out.key("inventory");
+        i.second.write(out);
+        out.end();
+      }
+      out.end();
+
+      out.key("from");
+      out.number(from);
+
+      out.key("log");
+      out.beginArray();
+      for (auto &l : log) {
+        l.write(out);
+      }
+      out.end();
+
+      out.end();
+    }
+  };
+
+  /**\brief Replay the journal
+   *
+   * Applies all complete updates in the journal to a freshly loaded game.
+   * An update that was cut short, e.g. by a crash, ends the replay. Also
+   * makes the game's current state the baseline for the next update.
+   *
+   * Without a save file, the journal's changes don't belong to the game, so
+   * it is removed instead, and the next update is a full save.
+   *
+   * \param[out] g      The game to update.
+   * \param[in]  loaded Whether the game was loaded from the save file.
+   *
+   * \returns The number of updates that were replayed.
+   */
+  std::size_t replay(G &g, bool loaded = true) {
+    std::size_t offset = 0;
+
+    count = 0;
+
+    if (!loaded) {
+      ::unlink(path.c_str());
+      broken = true;
+    }
+
+    mapping data(path);
+
+    while (offset < data.size) {
+      binary::reader in(data.data + offset, data.size - offset);
+
+      if (!apply(g, in)) {
+        break;
+      }
+
+      offset += in.consumed();
+      count++;
+    }
+
+    baseline(g);
+
+    return count;
+  }
+
+  /**\brief Collect changes
+   *
+   * Compares the revisions of the characters and inventories with those that
+   * were last saved, and collects everything that has changed since; this
+   * runs on the game's thread, but doesn't do any I/O, and only copies what
+   * changed. Also takes the entries that were moved out of the logbook.
+   *
+   * \param[in] g    The game to look at.
+   * \param[in] full Compact the journal with this update, whether it's due
+   *                 or not.
+   *
+   * \returns The changes, which may be empty.
+   */
+  update capture(G &g, bool full = false) {
+    update u;
+    const auto &parties = g.game.parties;
+
+    u.parties = parties.size();
+    stamps.resize(parties.size());
+
+    for (std::size_t p = 0; p < parties.size(); p++) {
+      auto &party = parties[p];
+      auto &stamp = stamps[p];
+
+      if (stamp.members.size() != party.size()) {
+        u.sizes.push_back({p, party.size()});
+        stamp.members.resize(party.size(), 0);
+      }
+
+      for (std::size_t m = 0; m < party.size(); m++) {
+        const auto r = party[m].revision();
+        if (r != stamp.members[m]) {
+          u.members.emplace_back(p, m, party[m]);
+          stamp.members[m] = r;
+        }
+      }
+
+      const auto r = party.inventory.revision();
+      if (r != stamp.inventory) {
+        u.inventories.emplace_back(p, party.inventory);
+        stamp.inventory = r;
+      }
+    }
+
+    const auto &book = g.interact.logbook;
+    u.from = std::max(log, book.first());
+    for (std::size_t i = u.from; i < book.size(); i++) {
+      u.log.push_back(book[i]);
+    }
+    log = book.size();
+
+    u.archive = g.interact.logbook.take();
+
+    if (full || broken || (!u.empty() && (++count >= compact))) {
+      u.full = g.capture();
+      count = 0;
+      broken = false;
+    }
+
+    return u;
+  }
+
+  /**\brief Write an update
+   *
+   * Appends the update to the journal and syncs it to disk. If the update
+   * contains a full snapshot, that is stored as the new save file and the
+   * journal is removed afterwards; that also recovers from earlier updates
+   * that failed to be written. Log entries that were moved out of the
+   * logbook are appended to its segment files; those are best effort, as
+   * they're not needed to restore the game. Runs on the autosave thread.
+   *
+   * \param[in] u The update to write.
+   *
+   * \returns 'true' if the update was written successfully.
+   */
+  bool commit(const update &u) {
+    bool ok = append(u);
+
+    u.archive.write();
+
+    if (u.full) {
+      ok = save::store(file, format, *u.full) &&
+           (::unlink(path.c_str()) == 0);
+    }
+
+    if (!ok) {
+      // the next update will be a full save again
+      broken = true;
+    }
+
+    return ok;
+  }
+
+protected:
+  const std::string file;
+  const std::string path;
+  const std::string format;
+  const std::size_t compact;
+
+  /**\brief Updates since the journal was last compacted. */
+  std::size_t count;
+
+  /**\brief Log entries that have been saved. */
+  std::size_t log;
+
+  /**\brief Set when the save file is behind the journal
+   *
+   * That is, when writing an update failed, or when there was no save file
+   * to begin with; the next update is a full save.
+   */
+  std::atomic<bool> broken;
+
+  /**\brief Revisions of what was last saved for a party
+   *
+   * Revisions are unique, and copies keep the revision of what they were
+   * copied from, so an unchanged revision means that a character or an
+   * inventory is still what was saved.
+   */
+  class stamp {
+  public:
+    std::vector<std::uint64_t> members;
+    std::uint64_t inventory;
+  };
+
+  std::vector<stamp> stamps;
+
+  void baseline(const G &g) {
+    const auto &parties = g.game.parties;
+
+    stamps.clear();
+
+    for (auto &party : parties) {
+      stamp s;
+      for (auto &c : party) {
+        s.members.push_back(c.revision());
+      }
+      s.inventory = party.inventory.revision();
+      stamps.push_back(s);
+    }
+
+    log = g.interact.logbook.size();
+  }
+
+  bool append(const update &u) {
+    const int fd =
+        ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+      return false;
+    }
+
+    bool ok;
+
+    {
+      output out(fd);
+      binary::writer w(out);
+
+      u.write(w);
+
+      ok = out.flush();
+    }
+
+    ok = (::fsync(fd) == 0) && ok;
+    ok = (::close(fd) == 0) && ok;
+
+    return ok;
+  }
+
+  static bool apply(G &g, reader &in) {
+    auto &parties = g.game.parties;
+    auto &book = g.interact.logbook;
+    std::size_t from = book.size();
+    std::string k;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    while (in.key(k)) {
+      if (k == "parties") {
+        std::size_t n;
+        if (in.number(n)) {
+          parties.resize(n);
+        }
+      } else if (k == "changes") {
+        in.beginArray();
+        while (in.next()) {
+          change(g, in);
+        }
+      } else if (k == "from") {
+        in.number(from);
+      } else if (k == "log") {
+        in.beginArray();
+        while (in.next()) {
+          logbook::entry entry;
+          if (entry.read(in) && (from++ >= book.size())) {
+            book.push(entry);
+          }
+        }
+      } else {
+        in.skip();
+      }
+    }
+
+    return in.good();
+  }
+
+  static void change(G &g, reader &in) {
+    auto &parties = g.game.parties;
+    std::size_t p = 0, m = 0;
+    std::string k;
+
+    if (!in.beginObject()) {
+      return;
+    }
+
+    while (in.key(k)) {
+      if (k == "party") {
+        in.number(p);
+      } else if (p >= parties.size()) {
+        in.skip();
+      } else if (k == "size") {
+        std::size_t n;
+        if (in.number(n)) {
+          parties[p].resize(n, g.game.blankCharacter());
+        }
+      } else if (k == "member") {
+        in.number(m);
+      } else if (k == "character") {
+        character c = g.game.blankCharacter();
+        if (c.read(in) && (m < parties[p].size())) {
+          parties[p][m] = c;
+        }
+      } else if (k == "inventory") {
+        parties[p].inventory.read(in);
+      } else {
+        in.skip();
+      }
+    }
+  }
+};
+}
+}
+
+#endif
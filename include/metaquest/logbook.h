@@ -0,0 +1,564 @@
+/**\file
+ * \brief Logbook
+ *
+ * A record of everything that happened in a game. Only the most recent
+ * entries are kept in memory; older ones are appended to rotated segment
+ * files on disk, if the logbook has been told where to put them, and dropped
+ * otherwise.
+ *
+ * Segment files are named after the archive path and the index of the
+ * segment, so "arena.log.3" would contain entries 3 * segment size and up.
+ * Each segment is a sequence of binary saves, one per batch of entries, each
+ * of which is an object with the index of the first entry as "from" and the
+ * "entries" themselves.
+ *
+ * Writing segment files is left to whoever owns the logbook: batches of moved
+ * entries can be taken out and written on another thread, e.g. along with an
+ * autosave. Archived entries can be read back from the segment files with
+ * history().
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_LOGBOOK_H)
+#define METAQUEST_LOGBOOK_H
+
+#include <ef.gy/json.h>
+
+#include <metaquest/mapping.h>
+#include <metaquest/save-binary.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace metaquest {
+/**\brief A logbook
+ *
+ * Keeps a bounded number of recent entries. Entries are numbered from the
+ * start of the game, so an entry keeps its index after older ones have been
+ * moved out of memory.
+ */
+class logbook {
+public:
+  /**\brief Position of a character, as party and position in the party. */
+  using position = std::array<std::size_t, 2>;
+
+  /**\brief A logbook entry
+   *
+   * Either a plain message, or an action with the characters that were
+   * involved in it.
+   */
+  class entry {
+  public:
+    entry(const std::string &pText = "") : text(pText), action(false) {}
+
+    entry(const std::string &pText, const position &pSource,
+          const std::vector<position> &pTargets)
+        : text(pText), action(true), source(pSource), targets(pTargets) {}
+
+    /**\brief Message, or description of the action. */
+    std::string text;
+
+    /**\brief Is this an action? */
+    bool action;
+
+    position source;
+    std::vector<position> targets;
+
+    bool load(efgy::json::json json) {
+      targets.clear();
+
+      if (json.isString()) {
+        text = json.asString();
+        action = false;
+        return true;
+      }
+
+      text = json("action").asString();
+      action = true;
+      source = decode(json("source"));
+      for (const auto &t : json("target").asArray()) {
+        targets.push_back(decode(t));
+      }
+
+      return true;
+    }
+
+    efgy::json::json json(void) const {
+      if (!action) {
+        return text;
+      }
+
+      efgy::json::json rv;
+
+      rv.toObject();
+      rv("action") = text;
+      rv("source") = encode(source);
+
+      auto &ts = rv("target").toArray();
+      for (const auto &t : targets) {
+        ts.push_back(encode(t));
+      }
+
+      return rv;
+    }
+
+    void write(save::writer &out) const {
+      if (!action) {
+        out.string(text);
+        return;
+      }
+
+      out.beginObject();
+      out.key("action");
+      out.string(text);
+      out.key("source");
+      write(out, source);
+      out.key("target");
+      out.beginArray();
+      for (const auto &t : targets) {
+        write(out, t);
+      }
+      out.end();
+      out.end();
+    }
+
+    bool read(save::reader &in) {
+      std::string k;
+
+      targets.clear();
+
+      if (in.peek() == save::reader::text) {
+        action = false;
+        return in.string(text);
+      }
+
+      action = true;
+
+      if (!in.beginObject()) {
+        return false;
+      }
+
+      while (in.key(k)) {
+        if (k == "action") {
+          in.string(text);
+        } else if (k == "source") {
+          read(in, source);
+        } else if (k == "target") {
+          in.beginArray();
+          while (in.next()) {
+            position p;
+            read(in, p);
+            targets.push_back(p);
+          }
+        } else {
+          in.skip();
+        }
+      }
+
+      return in.good();
+    }
+
+  protected:
+    static position decode(const efgy::json::json &json) {
+      const auto &a = json.asArray();
+      if (a.size() < 2) {
+        return {0, 0};
+      }
+      return {std::size_t(a[0].asNumber()), std::size_t(a[1].asNumber())};
+    }
+
+    static efgy::json::json encode(const position &p) {
+      efgy::json::json rv;
+
+      rv.push(efgy::json::json::numeric(p[0]));
+      rv.push(efgy::json::json::numeric(p[1]));
+
+      return rv;
+    }
+
+    static void write(save::writer &out, const position &p) {
+      out.beginArray();
+      out.number(p[0]);
+      out.number(p[1]);
+      out.end();
+    }
+
+    static bool read(save::reader &in, position &p) {
+      in.beginArray();
+      for (std::size_t i = 0; in.next(); i++) {
+        if (i < p.size()) {
+          in.number(p[i]);
+        } else {
+          in.skip();
+        }
+      }
+      return in.good();
+    }
+  };
+
+  /**\brief Entries moved out of memory
+   *
+   * Carries everything needed to write the entries to the segment files, so
+   * that can happen on another thread.
+   */
+  class batch {
+  public:
+    batch(void) : segment(1), keep(0), from(0) {}
+
+    /**\brief Prefix for the segment files. */
+    std::string path;
+
+    std::size_t segment;
+    std::size_t keep;
+
+    /**\brief Index of the first entry. */
+    std::size_t from;
+
+    std::vector<entry> entries;
+
+    bool empty(void) const { return entries.empty(); }
+
+    /**\brief Write to the segment files
+     *
+     * Appends the entries to the segment files they belong in, and deletes
+     * segment files that are too old to keep.
+     *
+     * \returns 'true' if the entries were written successfully.
+     */
+    bool write(void) const {
+      bool ok = true;
+      std::size_t at = from;
+      auto it = entries.begin();
+
+      while (it != entries.end()) {
+        const std::size_t s = at / segment;
+        const std::size_t n = std::min<std::size_t>((s + 1) * segment - at,
+                                                    entries.end() - it);
+        const std::string file = path + "." + std::to_string(s);
+        const int fd =
+            ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+        {
+          save::output out(fd);
+          save::binary::writer w(out);
+
+          w.beginObject();
+          w.key("from");
+          w.number(at);
+          w.key("entries");
+          w.beginArray();
+          for (auto e = it; e != it + n; e++) {
+            e->write(w);
+          }
+          w.end();
+          w.end();
+
+          ok = out.flush() && ok;
+        }
+
+        if (fd >= 0) {
+          ::close(fd);
+        }
+
+        if (s >= keep) {
+          std::remove((path + "." + std::to_string(s - keep)).c_str());
+        }
+
+        at += n;
+        it += n;
+      }
+
+      return ok;
+    }
+
+    /**\brief Read from a segment file
+     *
+     * \param[in] in Reader positioned at a batch in a segment file.
+     *
+     * \returns 'true' if a batch was read successfully.
+     */
+    bool read(save::reader &in) {
+      std::string k;
+
+      entries.clear();
+
+      if (!in.beginObject()) {
+        return false;
+      }
+
+      while (in.key(k)) {
+        if (k == "from") {
+          in.number(from);
+        } else if (k == "entries") {
+          in.beginArray();
+          while (in.next()) {
+            entry e;
+            if (!e.read(in)) {
+              return false;
+            }
+            entries.push_back(e);
+          }
+        } else {
+          in.skip();
+        }
+      }
+
+      return in.good();
+    }
+  };
+
+  /**\brief Construct with limits
+   *
+   * \param[in] pCapacity How many entries to keep in memory.
+   * \param[in] pSegment  How many entries to put in each segment file.
+   * \param[in] pKeep     How many segment files to keep; older ones are
+   *                      deleted.
+   */
+  logbook(std::size_t pCapacity = 256, std::size_t pSegment = 4096,
+          std::size_t pKeep = 16)
+      : capacity(pCapacity), segment(pSegment), keep(pKeep), start(0) {}
+
+  /**\brief Set archive path
+   *
+   * Sets where to put entries that no longer fit in memory; if this isn't
+   * set, those entries are dropped.
+   *
+   * \param[in] pPath Prefix for the segment files.
+   */
+  void archive(const std::string &pPath) { path = pPath; }
+
+  /**\brief Add an entry
+   *
+   * Adds an entry at the end, and moves the oldest entry out of memory if
+   * the logbook is full. Moved entries are kept until they're taken with
+   * take(); only if a whole segment's worth piles up are they written out
+   * right away.
+   *
+   * \param[in] e The new entry.
+   */
+  void push(const entry &e) {
+    recent.push_back(e);
+    trim(path != "");
+
+    if (evicted.size() >= segment) {
+      // nobody is taking batches to write them elsewhere
+      flush();
+    }
+  }
+
+  /**\brief Number of entries
+   *
+   * \returns The number of entries since the start of the game, including
+   *          those that aren't kept in memory anymore.
+   */
+  std::size_t size(void) const { return start + recent.size(); }
+
+  /**\brief Oldest entry in memory
+   *
+   * \returns The index of the oldest entry that can still be looked up.
+   */
+  std::size_t first(void) const { return start; }
+
+  /**\brief Look up an entry
+   *
+   * \param[in] i Index of the entry; needs to be between first() and size().
+   *
+   * \returns The entry with the given index.
+   */
+  const entry &operator[](std::size_t i) const { return recent[i - start]; }
+
+  /**\brief Renumber entries
+   *
+   * Sets the index of the oldest entry in memory, e.g. after loading the
+   * logbook from a save.
+   *
+   * \param[in] pStart The new index of the oldest entry.
+   */
+  void rebase(std::size_t pStart) { start = pStart; }
+
+  /**\brief Take moved entries
+   *
+   * Takes the entries that were moved out of memory since the last call, to
+   * write them to the segment files elsewhere.
+   *
+   * \returns The moved entries; empty if there is no archive path.
+   */
+  batch take(void) {
+    batch rv;
+
+    rv.path = path;
+    rv.segment = segment;
+    rv.keep = keep;
+    rv.from = start - evicted.size();
+    rv.entries.swap(evicted);
+
+    return rv;
+  }
+
+  /**\brief Write out moved entries
+   *
+   * Takes the moved entries and writes them to the segment files right away.
+   *
+   * \returns 'true' if the entries were written successfully.
+   */
+  bool flush(void) { return take().write(); }
+
+  /**\brief Look up archived entries
+   *
+   * Reads entries that were moved out of memory back from the segment files.
+   * Entries in segment files that were deleted, or that haven't been written
+   * yet, can't be found.
+   *
+   * \param[in] from Index of the first entry to look up.
+   * \param[in] to   Index after the last entry to look up.
+   *
+   * \returns The first consecutive entries in the range that could be found.
+   */
+  batch history(std::size_t from, std::size_t to) const {
+    batch rv;
+
+    rv.path = path;
+    rv.segment = segment;
+    rv.keep = keep;
+    rv.from = from;
+
+    if ((path == "") || (from >= to)) {
+      return rv;
+    }
+
+    for (std::size_t s = from / segment; s <= (to - 1) / segment; s++) {
+      mapping data(path + "." + std::to_string(s));
+      std::size_t offset = 0;
+
+      while (offset < data.size) {
+        save::binary::reader in(data.data + offset, data.size - offset);
+        batch b;
+
+        if (!b.read(in)) {
+          break;
+        }
+
+        offset += in.consumed();
+
+        for (std::size_t i = 0; i < b.entries.size(); i++) {
+          const std::size_t at = b.from + i;
+
+          if (rv.entries.empty() && (at >= from) && (at < to)) {
+            rv.from = at;
+          }
+          if ((at == rv.from + rv.entries.size()) && (at < to)) {
+            rv.entries.push_back(b.entries[i]);
+          }
+        }
+      }
+
+      if (!rv.entries.empty() && (rv.from + rv.entries.size() < to) &&
+          (rv.from + rv.entries.size() < (s + 1) * segment)) {
+        // there's a gap, so whatever comes after doesn't follow on
+        break;
+      }
+    }
+
+    return rv;
+  }
+
+  efgy::json::json json(void) const {
+    efgy::json::json rv;
+
+    rv.toArray();
+    for (const auto &e : recent) {
+      rv.push(e.json());
+    }
+
+    return rv;
+  }
+
+  bool load(efgy::json::json json) {
+    recent.clear();
+    start = 0;
+
+    for (const auto &j : json.asArray()) {
+      entry e;
+      e.load(j);
+      recent.push_back(e);
+      trim(false);
+    }
+
+    return true;
+  }
+
+  void write(save::writer &out) const {
+    out.beginArray();
+    for (const auto &e : recent) {
+      e.write(out);
+    }
+    out.end();
+  }
+
+  bool read(save::reader &in) {
+    recent.clear();
+    start = 0;
+
+    if (!in.beginArray()) {
+      return false;
+    }
+
+    while (in.next()) {
+      entry e;
+      if (!e.read(in)) {
+        return false;
+      }
+      recent.push_back(e);
+      trim(false);
+    }
+
+    return in.good();
+  }
+
+protected:
+  std::size_t capacity;
+  std::size_t segment;
+  std::size_t keep;
+
+  std::string path;
+
+  /**\brief Index of the oldest entry in memory. */
+  std::size_t start;
+
+  std::deque<entry> recent;
+
+  /**\brief Entries that still need to be written to a segment file. */
+  std::vector<entry> evicted;
+
+  /**\brief Move old entries out of memory
+   *
+   * \param[in] archiving Keep the entries to write them to a segment file,
+   *                      rather than dropping them.
+   */
+  void trim(bool archiving) {
+    while (recent.size() > capacity) {
+      if (archiving) {
+        evicted.push_back(recent.front());
+      }
+      recent.pop_front();
+      start++;
+    }
+  }
+};
+}
+
+#endif
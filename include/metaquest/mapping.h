@@ -0,0 +1,80 @@
+/**\file
+ * \brief Memory-mapped files
+ *
+ * Some of the game's data - compiled name models, binary saves - is read
+ * straight from memory-mapped files rather than parsed into new objects. This
+ * header contains the wrapper for such mappings.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_MAPPING_H)
+#define METAQUEST_MAPPING_H
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace metaquest {
+/**\brief Read-only file mapping
+ *
+ * Maps a whole file into memory for reading. If the file can't be opened or
+ * mapped, the mapping is empty; check with valid() before using the data.
+ */
+class mapping {
+public:
+  /**\brief Map a file
+   *
+   * \param[in] file The file to map.
+   */
+  mapping(const std::string &file) : data(nullptr), size(0) {
+    const int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+
+    struct stat st;
+    if ((::fstat(fd, &st) == 0) && (st.st_size > 0)) {
+      void *m = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m != MAP_FAILED) {
+        data = static_cast<const char *>(m);
+        size = st.st_size;
+      }
+    }
+
+    ::close(fd);
+  }
+
+  mapping(const mapping &) = delete;
+  mapping &operator=(const mapping &) = delete;
+
+  ~mapping(void) {
+    if (data != nullptr) {
+      ::munmap(const_cast<char *>(data), size);
+    }
+  }
+
+  /**\brief Was the file mapped successfully?
+   *
+   * \returns 'true' if the mapping contains the file's data.
+   */
+  bool valid(void) const { return data != nullptr; }
+
+  /**\brief Start of the mapped data. */
+  const char *data;
+
+  /**\brief Size of the mapped data, in bytes. */
+  std::size_t size;
+};
+}
+
+#endif
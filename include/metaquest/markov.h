@@ -0,0 +1,616 @@
+/**\file
+ * \brief Compiled Markov chains
+ *
+ * Names are generated with Markov chains that are trained on census data. This
+ * header contains a flat representation of such a chain, which is trained
+ * ahead of time by the data pipeline and then either compiled right into the
+ * programme or memory-mapped from a binary file, so there's no need for a
+ * training pass at runtime.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_MARKOV_H)
+#define METAQUEST_MARKOV_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace metaquest {
+/**\brief Markov chains
+ *
+ * Contains compiled Markov chains, the trainer that produces them and an
+ * adapter to use them as name generators.
+ */
+namespace markov {
+/**\brief Chain order
+ *
+ * The number of symbols that a chain keeps as its memory. These are packed
+ * into a single integer, one byte per symbol.
+ */
+static const std::size_t order = 3;
+
+/**\brief Chain state
+ *
+ * A state in a compiled chain. Contains the last few symbols that were
+ * generated, and the range of transitions that lead out of this state.
+ */
+class state {
+public:
+  /**\brief Packed memory of the state; 0 is the initial state. */
+  std::uint32_t context;
+
+  /**\brief Index of the first transition out of this state. */
+  std::uint32_t first;
+
+  /**\brief Number of transitions out of this state. */
+  std::uint32_t count;
+
+  /**\brief Sum of the weights of all transitions out of this state. */
+  std::uint32_t total;
+};
+
+/**\brief State transition
+ *
+ * A transition out of a state. Weights are cumulative over the transitions of
+ * a state, so that picking one is a binary search.
+ */
+class transition {
+public:
+  /**\brief Symbol to emit; 0 terminates the sequence. */
+  std::uint32_t symbol;
+
+  /**\brief Cumulative weight, up to and including this transition. */
+  std::uint32_t weight;
+
+  /**\brief Index of the state after emitting the symbol. */
+  std::uint32_t next;
+};
+
+/**\brief Binary model header
+ *
+ * Compiled models can also be stored in binary files, which are memory-mapped
+ * at runtime instead of being compiled into the programme. Such a file starts
+ * with this header, followed by the state table and then the transition table,
+ * in native byte order.
+ */
+class header {
+public:
+  /**\brief File magic: "MQNM". */
+  char magic[4];
+
+  /**\brief Format version; currently 1. */
+  std::uint32_t version;
+
+  /**\brief Number of entries in the state table. */
+  std::uint32_t stateCount;
+
+  /**\brief Number of entries in the transition table. */
+  std::uint32_t transitionCount;
+};
+
+/**\brief Compiled Markov chain
+ *
+ * A read-only view of the states and transitions of a trained chain. The
+ * tables are usually constexpr arrays generated by the data pipeline.
+ */
+class model {
+public:
+  constexpr model(const state *pStates, std::size_t pStateCount,
+                  const transition *pTransitions, std::size_t pTransitionCount)
+      : states(pStates), stateCount(pStateCount), transitions(pTransitions),
+        transitionCount(pTransitionCount) {}
+
+  template <std::size_t s, std::size_t t>
+  constexpr model(const state (&pStates)[s],
+                  const transition (&pTransitions)[t])
+      : model(pStates, s, pTransitions, t) {}
+
+  const state *states;
+  std::size_t stateCount;
+  const transition *transitions;
+  std::size_t transitionCount;
+
+  /**\brief Use binary model data
+   *
+   * Creates a model that refers to the tables in a binary model, e.g. in a
+   * memory-mapped file; nothing is copied, so the data needs to outlive the
+   * model. The tables are checked for consistency first.
+   *
+   * \param[in] data Start of the binary model.
+   * \param[in] size Size of the binary model, in bytes.
+   *
+   * \returns The model, if the data is a valid binary model.
+   */
+  static std::optional<model> map(const char *data, std::size_t size) {
+    header h;
+
+    if (size < sizeof(h)) {
+      return std::optional<model>();
+    }
+
+    std::memcpy(&h, data, sizeof(h));
+
+    if ((std::memcmp(h.magic, "MQNM", 4) != 0) || (h.version != 1) ||
+        (size < sizeof(h) + h.stateCount * sizeof(state) +
+                    h.transitionCount * sizeof(transition))) {
+      return std::optional<model>();
+    }
+
+    const state *s = reinterpret_cast<const state *>(data + sizeof(h));
+    const transition *t =
+        reinterpret_cast<const transition *>(s + h.stateCount);
+    const model m(s, h.stateCount, t, h.transitionCount);
+
+    return m.consistent() ? m : std::optional<model>();
+  }
+
+  /**\brief Check the tables
+   *
+   * Makes sure that the first state is the initial state, that all of the
+   * indices in the tables are in range and that the weights add up, so that
+   * sampling from the model is safe.
+   *
+   * \returns 'true' if the tables are consistent.
+   */
+  bool consistent(void) const {
+    if ((stateCount > 0) && (states[0].context != 0)) {
+      // sampling starts at state 0, so that needs to be the initial state
+      return false;
+    }
+
+    for (std::size_t i = 0; i < stateCount; i++) {
+      const state &s = states[i];
+      if ((s.count == 0) || (s.total == 0) ||
+          (std::size_t(s.first) + s.count > transitionCount) ||
+          (transitions[s.first + s.count - 1].weight != s.total)) {
+        return false;
+      }
+    }
+
+    for (std::size_t i = 0; i < transitionCount; i++) {
+      if (transitions[i].next >= stateCount) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /**\brief Pick a transition
+   *
+   * \param[in] s The state to leave.
+   * \param[in] r A random number in the range [0, s.total).
+   *
+   * \returns The transition that 'r' falls into.
+   */
+  const transition &pick(const state &s, std::uint32_t r) const {
+    const transition *begin = transitions + s.first;
+    const transition *end = begin + s.count;
+
+    return *std::upper_bound(
+        begin, end, r,
+        [](std::uint32_t v, const transition &t) { return v < t.weight; });
+  }
+
+  /**\brief Generate a sequence
+   *
+   * \param[in] rng The PRNG to use.
+   *
+   * \returns A random sequence drawn from the chain.
+   */
+  template <typename random> std::string operator()(random &rng) const {
+    std::string rv;
+
+    if (stateCount == 0) {
+      return rv;
+    }
+
+    for (const state *s = states;;) {
+      const transition &t = pick(*s, rng() % s->total);
+      if (t.symbol == 0) {
+        break;
+      }
+      rv.push_back(char(t.symbol));
+      s = states + t.next;
+    }
+
+    return rv;
+  }
+};
+
+/**\brief Length-bounded sampler
+ *
+ * Draws sequences from a model under a maximum length, without generating
+ * sequences and throwing away the ones that turn out too long. For every state
+ * and every number of remaining symbols, this precomputes the probability that
+ * the chain terminates in time, and weighs transitions by that probability.
+ * The result has the same distribution as rejection sampling, but each
+ * sequence costs at most 'length' steps.
+ */
+class bounded {
+public:
+  /**\brief Construct with model and maximum length
+   *
+   * \param[in] pModel  The model to sample from.
+   * \param[in] pLength The maximum length of generated sequences.
+   */
+  bounded(const model &pModel, std::size_t pLength)
+      : data(pModel), length(pLength),
+        mass(pModel.stateCount * (pLength + 1), 0) {
+    for (std::size_t l = 0; l <= length; l++) {
+      for (std::size_t s = 0; s < data.stateCount; s++) {
+        const state &st = data.states[s];
+        double m = 0;
+        std::uint32_t previous = 0;
+
+        for (std::size_t i = st.first; i < st.first + st.count; i++) {
+          const transition &t = data.transitions[i];
+          const double w = t.weight - previous;
+          previous = t.weight;
+
+          if (t.symbol == 0) {
+            m += w;
+          } else if (l > 0) {
+            m += w * at(t.next, l - 1);
+          }
+        }
+
+        mass[s * (length + 1) + l] = m / st.total;
+      }
+    }
+  }
+
+  /**\brief Generate a sequence
+   *
+   * \param[in] rng The PRNG to use.
+   *
+   * \returns A random, non-empty sequence of at most 'length' symbols, or an
+   *          empty sequence if the model can't produce one.
+   */
+  template <typename random> std::string operator()(random &rng) const {
+    std::string rv;
+
+    if (data.stateCount == 0) {
+      return rv;
+    }
+
+    std::size_t s = 0;
+
+    for (std::size_t r = length;; r--) {
+      const state &st = data.states[s];
+      double total = 0;
+
+      for (std::size_t i = st.first; i < st.first + st.count; i++) {
+        total += weight(st, i, r, rv.empty());
+      }
+
+      if (total <= 0) {
+        return rv;
+      }
+
+      double x = std::uniform_real_distribution<double>(0, total)(rng);
+      std::size_t i = st.first;
+
+      for (; i < st.first + st.count - 1; i++) {
+        x -= weight(st, i, r, rv.empty());
+        if (x < 0) {
+          break;
+        }
+      }
+
+      const transition &t = data.transitions[i];
+      if (t.symbol == 0) {
+        return rv;
+      }
+
+      rv.push_back(char(t.symbol));
+      s = t.next;
+    }
+  }
+
+  /**\brief The model; the tables it refers to need to outlive this. */
+  const model data;
+
+  const std::size_t length;
+
+protected:
+  /**\brief Termination probabilities
+   *
+   * For each state and number of remaining symbols, the probability that the
+   * chain terminates before running out of symbols.
+   */
+  std::vector<float> mass;
+
+  float at(std::size_t s, std::size_t l) const {
+    return mass[s * (length + 1) + l];
+  }
+
+  double weight(const state &st, std::size_t i, std::size_t remaining,
+                bool first) const {
+    const transition &t = data.transitions[i];
+    const std::uint32_t previous =
+        i == st.first ? 0 : data.transitions[i - 1].weight;
+    const double w = t.weight - previous;
+
+    if (t.symbol == 0) {
+      return first ? 0 : w;
+    }
+
+    return remaining > 0 ? w * at(t.next, remaining - 1) : 0;
+  }
+};
+
+/**\brief Bounded samplers of a model
+ *
+ * Samplers only depend on the model and the length, and they're read-only
+ * once set up, so they're shared between all users of a model. Whatever owns
+ * the model's tables should own this as well, so that the samplers don't
+ * outlive the tables they were computed from.
+ */
+class samplers {
+public:
+  samplers(const model &pModel) : data(pModel) {}
+
+  samplers(const samplers &) = delete;
+  samplers &operator=(const samplers &) = delete;
+
+  /**\brief Get a shared sampler
+   *
+   * \param[in] length The maximum length of generated sequences.
+   *
+   * \returns A shared sampler for the length, set up on first use.
+   */
+  std::shared_ptr<const bounded> get(std::size_t length) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto &b = bounds[length];
+    if (!b) {
+      b = std::make_shared<const bounded>(data, length);
+    }
+
+    return b;
+  }
+
+  const model data;
+
+protected:
+  mutable std::mutex mutex;
+  mutable std::map<std::size_t, std::shared_ptr<const bounded>> bounds;
+};
+
+/**\brief Markov chain trainer
+ *
+ * Accumulates weighted sample sequences and flattens them into the tables
+ * used by a compiled model. This is what the data pipeline uses to turn census
+ * data into a header.
+ */
+class trainer {
+public:
+  /**\brief Add a sample
+   *
+   * \param[in] sequence The sample sequence.
+   * \param[in] weight   How often the sample occurs.
+   */
+  void add(const std::string &sequence, std::uint32_t weight) {
+    std::uint32_t context = 0;
+
+    for (std::size_t i = 0; i <= sequence.size(); i++) {
+      const std::uint32_t symbol =
+          i < sequence.size() ? (unsigned char)sequence[i] : 0;
+      counts[context][symbol] += weight;
+      context = push(context, symbol);
+    }
+  }
+
+  template <std::size_t n>
+  void add(const std::array<std::tuple<const char *, long>, n> &data) {
+    for (const auto &d : data) {
+      add(std::get<0>(d), std::get<1>(d));
+    }
+  }
+
+  /**\brief Append a symbol to a packed context
+   *
+   * \param[in] context The context to append to.
+   * \param[in] symbol  The symbol to append.
+   *
+   * \returns The new context, with the oldest symbol dropped.
+   */
+  static std::uint32_t push(std::uint32_t context, std::uint32_t symbol) {
+    return ((context << 8) | symbol) & ((1 << (8 * order)) - 1);
+  }
+
+  /**\brief Flatten the chain
+   *
+   * \param[out] states      The states of the compiled chain.
+   * \param[out] transitions The transitions of the compiled chain.
+   *
+   * \returns 'true' if the chain could be flattened.
+   */
+  bool compile(std::vector<state> &states,
+               std::vector<transition> &transitions) const {
+    std::map<std::uint32_t, std::uint32_t> index;
+
+    states.clear();
+    transitions.clear();
+
+    for (const auto &c : counts) {
+      index[c.first] = states.size();
+      states.push_back({c.first, 0, 0, 0});
+    }
+
+    for (auto &s : states) {
+      std::uint64_t total = 0;
+
+      s.first = transitions.size();
+
+      for (const auto &t : counts.at(s.context)) {
+        total += t.second;
+        if (total > UINT32_MAX) {
+          return false;
+        }
+
+        transitions.push_back(
+            {t.first, std::uint32_t(total),
+             t.first == 0 ? 0 : index.at(push(s.context, t.first))});
+      }
+
+      s.count = transitions.size() - s.first;
+      s.total = total;
+    }
+
+    return true;
+  }
+
+  /**\brief Write the chain as a header
+   *
+   * Writes a header that defines constexpr tables for the chain, along with a
+   * model that refers to them.
+   *
+   * \param[out] out  Where to write the header to.
+   * \param[in]  name Identifier of the model in the 'data' namespace.
+   *
+   * \returns 'true' if the header was written successfully.
+   */
+  bool write(std::ostream &out, const std::string &name) const {
+    std::vector<state> states;
+    std::vector<transition> transitions;
+
+    if (!compile(states, transitions)) {
+      return false;
+    }
+
+    out << "#include <metaquest/markov.h>\n"
+        << "namespace data {\n"
+        << "inline constexpr metaquest::markov::state " << name
+        << "_states[] = {\n";
+    for (const auto &s : states) {
+      out << " {" << s.context << "," << s.first << "," << s.count << ","
+          << s.total << "},\n";
+    }
+    out << "};\n"
+        << "inline constexpr metaquest::markov::transition " << name
+        << "_transitions[] = {\n";
+    for (const auto &t : transitions) {
+      out << " {" << t.symbol << "," << t.weight << "," << t.next << "},\n";
+    }
+    out << "};\n"
+        << "inline constexpr metaquest::markov::model " << name << "("
+        << name << "_states, " << name << "_transitions);\n"
+        << "}\n";
+
+    return bool(out);
+  }
+
+  /**\brief Write the chain as a binary model
+   *
+   * Writes the chain in the format expected by model::map().
+   *
+   * \param[out] out Where to write the binary model to.
+   *
+   * \returns 'true' if the model was written successfully.
+   */
+  bool write(std::ostream &out) const {
+    std::vector<state> states;
+    std::vector<transition> transitions;
+
+    if (!compile(states, transitions)) {
+      return false;
+    }
+
+    const header h = {{'M', 'Q', 'N', 'M'},
+                      1,
+                      std::uint32_t(states.size()),
+                      std::uint32_t(transitions.size())};
+
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char *>(states.data()),
+              states.size() * sizeof(state));
+    out.write(reinterpret_cast<const char *>(transitions.data()),
+              transitions.size() * sizeof(transition));
+
+    return bool(out);
+  }
+
+protected:
+  /**\brief Transition counts
+   *
+   * Maps packed contexts to the accumulated weights of the symbols that
+   * followed them in the samples.
+   */
+  std::map<std::uint32_t, std::map<std::uint32_t, std::uint64_t>> counts;
+};
+
+/**\brief Name generator
+ *
+ * Adapts a compiled model to the generator interface used by the name
+ * templates: construct with a PRNG and the model's samplers, then use
+ * operator>> to get new names out of it.
+ *
+ * \tparam T The type used for single characters in names.
+ * \tparam R The PRNG type.
+ */
+template <typename T = char, typename R = std::mt19937> class chain {
+public:
+  typedef R random;
+
+  chain(random &pRNG, const samplers &pSamplers)
+      : rng(pRNG), data(pSamplers.data), shared(pSamplers) {}
+
+  chain &operator>>(std::basic_string<T> &value) {
+    const std::string s = data(rng);
+    value.assign(s.begin(), s.end());
+    return *this;
+  }
+
+  /**\brief Generate a name with a maximum length
+   *
+   * Uses a bounded sampler for the given length, which is looked up on first
+   * use and then kept around for later calls.
+   *
+   * \param[out] value  Where to write the name to.
+   * \param[in]  length The maximum length of the name.
+   *
+   * \returns A reference to 'value'.
+   */
+  std::basic_string<T> &sample(std::basic_string<T> &value,
+                               std::size_t length) {
+    auto &b = bounds[length];
+    if (!b) {
+      b = shared.get(length);
+    }
+
+    const std::string s = (*b)(rng);
+    value.assign(s.begin(), s.end());
+    return value;
+  }
+
+protected:
+  random &rng;
+  const model &data;
+  const samplers &shared;
+  std::map<std::size_t, std::shared_ptr<const bounded>> bounds;
+};
+}
+}
+
+#endif
@@ -16,15 +16,32 @@
 #if !defined(METAQUEST_NAME_H)
 #define METAQUEST_NAME_H
 
-#include <ef.gy/markov.h>
+#include <metaquest/markov.h>
 #include <ef.gy/json.h>
 
+#include <metaquest/mapping.h>
+#include <metaquest/save.h>
+
+#if !defined(METAQUEST_NO_BUILTIN_NAMES)
 #include <data/female.first.h>
 #include <data/male.first.h>
 #include <data/all.last.h>
+#endif
 
 #include <algorithm>
+#include <array>
 #include <cctype>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 namespace metaquest {
 /**\brief Names
@@ -49,9 +66,9 @@ static const unsigned long seed = std::random_device()();
  *
  * \tparam T         The type used for single characters in names.
  * \tparam generator A class that can generate random names, e.g. a
- *                   variant of efgy::markov::chain.
+ *                   variant of markov::chain.
  */
-template <typename T = char, typename generator = efgy::markov::chain<T, 3>>
+template <typename T = char, typename generator = markov::chain<T>>
 class name {
 public:
   /**\brief Name type
@@ -125,6 +142,40 @@ public:
 
     return rv;
   }
+
+  void write(save::writer &out) const {
+    out.beginObject();
+    out.key("name");
+    out.string(value);
+    out.key("type");
+    out.number(type);
+    out.end();
+  }
+
+  bool read(save::reader &in) {
+    std::string k;
+    long t = otherName;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    while (in.key(k)) {
+      if (k == "name") {
+        std::string v;
+        in.string(v);
+        value.assign(v.begin(), v.end());
+      } else if (k == "type") {
+        in.number(t);
+      } else {
+        in.skip();
+      }
+    }
+
+    type = (enum type)t;
+
+    return in.good();
+  }
 };
 
 /**\brief A proper name
@@ -133,61 +184,127 @@ public:
  * have both a given name and a family name, and may quite likely also
  * have a nickname. This class groups all of these together.
  *
+ * Names are stored as a single string with the individual names
+ * separated by spaces, so that the full and display names are just
+ * views of that string and don't need to be built every time they're
+ * used. Short names fit in the string's own buffer; longer ones are
+ * kept on the heap.
+ *
+ * Where each name starts is kept in a small array in the object
+ * itself, as names rarely have more than a handful of parts. Names
+ * past the array's capacity are merged into the last one, so the
+ * full name stays the same.
+ *
  * \tparam T         The type used for single characters in names.
  * \tparam generator A class that can generate random names, e.g. a
- *                   variant of efgy::markov::chain.
+ *                   variant of markov::chain.
  */
-template <typename T = char, typename generator = efgy::markov::chain<T, 3>>
-class proper : public std::vector<name<T, generator>> {
+template <typename T = char, typename generator = markov::chain<T>>
+class proper {
 public:
-  /**\brief Query the full name
+  typedef name<T, generator> value_type;
+  typedef std::basic_string_view<T> view;
+
+  /**\brief Most names that are kept apart. */
+  static const std::size_t capacity = 8;
+
+  proper(void) : count(0), shown(none) {}
+
+  std::size_t size(void) const { return count; }
+
+  bool empty(void) const { return count == 0; }
+
+  /**\brief Access a name
    *
-   * This function provides access to a "full" name string, with
-   * all the names in the vector appended with spaces inbetween.
+   * \param[in] i Index of the name to access.
    *
-   * \returns A string with the proper, full name.
+   * \returns A copy of the i-th name.
    */
-  std::basic_string<T> full(void) const {
-    std::basic_string<T> s = "";
+  value_type operator[](std::size_t i) const {
+    return value_type(std::basic_string<T>(part(i)), type(i));
+  }
 
-    for (const name<T, generator> &n : *this) {
-      if (s.size() > 0) {
-        s += " ";
-      }
-      s += n.value;
+  /**\brief View of a name
+   *
+   * \param[in] i Index of the name to look at.
+   *
+   * \returns A view of the text of the i-th name.
+   */
+  view part(std::size_t i) const {
+    return view(text.data() + parts[i].offset, parts[i].size);
+  }
+
+  /**\brief Type of a name
+   *
+   * \param[in] i Index of the name to look at.
+   *
+   * \returns The type of the i-th name.
+   */
+  enum value_type::type type(std::size_t i) const {
+    return (enum value_type::type)parts[i].type;
+  }
+
+  /**\brief Add a name
+   *
+   * Appends a name.
+   *
+   * \param[in] n The name to add.
+   */
+  void push_back(const value_type &n) {
+    if (count > 0) {
+      text.push_back(' ');
     }
 
-    return s;
+    if (count == capacity) {
+      text.append(n.value);
+      parts[count - 1].size = text.size() - parts[count - 1].offset;
+      return;
+    }
+
+    parts[count] = {std::uint32_t(text.size()), std::uint32_t(n.value.size()),
+                    std::uint8_t(n.type)};
+    text.append(n.value);
+
+    if ((shown == none) && ((n.type == value_type::givenName) ||
+                            (n.type == value_type::callSign))) {
+      shown = count;
+    }
+
+    count++;
+  }
+
+  void clear(void) {
+    text.clear();
+    count = 0;
+    shown = none;
   }
 
+  /**\brief Query the full name
+   *
+   * This function provides access to a "full" name string, with
+   * all the names appended with spaces inbetween.
+   *
+   * \returns A view of the proper, full name.
+   */
+  view full(void) const { return view(text); }
+
   /**\brief Query the display name
    *
    * Using the full name everywhere would be quite cumbersome in a
    * game, so this function can be used to get a shorter version.
    *
-   * \returns A shorter version of the name, if that can be
-   *          deduced easily.
+   * \returns A view of a shorter version of the name, if that can
+   *          be deduced easily.
    */
-  std::basic_string<T> display(void) const {
-    for (const name<T, generator> &n : *this) {
-      switch (n.type) {
-      case name<T, generator>::givenName:
-        return n.value;
-      case name<T, generator>::callSign:
-        return n.value;
-      default:
-        break;
-      }
-    }
-
-    return full();
+  view display(void) const {
+    return shown < count ? part(shown) : full();
   }
 
   bool load(efgy::json::json json) {
-    this->clear();
+    clear();
 
     for (const auto n : json.asArray()) {
-      this->push_back(name<T, generator>(n));
+      push_back(value_type(n));
     }
 
     return true;
@@ -197,15 +314,62 @@ public:
     efgy::json::json rv;
 
     rv.toArray();
-    for (auto &n : *this) {
-      rv.push(n.json());
+    for (std::size_t i = 0; i < size(); i++) {
+      rv.push((*this)[i].json());
     }
 
     return rv;
   }
+
+  void write(save::writer &out) const {
+    out.beginArray();
+    for (std::size_t i = 0; i < size(); i++) {
+      (*this)[i].write(out);
+    }
+    out.end();
+  }
+
+  bool read(save::reader &in) {
+    clear();
+
+    if (!in.beginArray()) {
+      return false;
+    }
+
+    while (in.next()) {
+      value_type n(std::basic_string<T>(), value_type::otherName);
+      if (!n.read(in)) {
+        return false;
+      }
+      push_back(n);
+    }
+
+    return in.good();
+  }
+
+protected:
+  /**\brief Name in the text buffer
+   *
+   * Where a single name starts in the text buffer, how long it is and
+   * what type of name it is.
+   */
+  class entry {
+  public:
+    std::uint32_t offset;
+    std::uint32_t size;
+    std::uint8_t type;
+  };
+
+  /**\brief Index of the display name, if there is none. */
+  static const std::uint32_t none = std::uint32_t(-1);
+
+  std::basic_string<T> text;
+  std::array<entry, capacity> parts;
+  std::uint32_t count;
+  std::uint32_t shown;
 };
 
-template <typename T = char, typename generator = efgy::markov::chain<T, 3>>
+template <typename T = char, typename generator = markov::chain<T>>
 class simple : public proper<T, generator> {
 public:
   typedef proper<T, generator> parent;
@@ -219,6 +383,151 @@ public:
  * based on historic census data.
  */
 namespace american {
+template <typename T, typename generator> class context;
+
+/**\brief Name data set
+ *
+ * The models that American names are generated from. By default
+ * these are the models compiled into the programme, but other data
+ * sets - e.g. for other locales - can be memory-mapped from the
+ * binary models written by the data pipeline, and selected at
+ * runtime.
+ *
+ * Define METAQUEST_NO_BUILTIN_NAMES to leave the compiled models out
+ * of the programme; a data set then needs to be loaded and selected
+ * before generating any names.
+ */
+class dataset {
+public:
+  dataset(const markov::model &pFemaleFirst, const markov::model &pMaleFirst,
+          const markov::model &pAllLast)
+      : femaleFirst(pFemaleFirst), maleFirst(pMaleFirst), allLast(pAllLast),
+        femaleFirstSamplers(femaleFirst), maleFirstSamplers(maleFirst),
+        allLastSamplers(allLast) {}
+
+  /**\brief Model for female given names. */
+  markov::model femaleFirst;
+
+  /**\brief Model for male given names. */
+  markov::model maleFirst;
+
+  /**\brief Model for family names. */
+  markov::model allLast;
+
+  /**\brief Bounded samplers for the models
+   *
+   * These belong to the data set, so they go away along with the
+   * models they were computed from.
+   */
+  markov::samplers femaleFirstSamplers;
+  markov::samplers maleFirstSamplers;
+  markov::samplers allLastSamplers;
+
+  /**\brief Load a data set
+   *
+   * Maps the binary models 'female.first.mqn', 'male.first.mqn' and
+   * 'all.last.mqn' from a directory. The models aren't copied, and
+   * loaded data sets stay mapped for the lifetime of the programme,
+   * as generators may refer to them at any time.
+   *
+   * \param[in] directory Where to find the binary models.
+   *
+   * \returns The data set, or a null pointer if any of the models
+   *          can't be mapped or aren't valid.
+   */
+  static std::shared_ptr<const dataset> load(const std::string &directory) {
+    static std::map<std::string, std::shared_ptr<const dataset>> loaded;
+
+    std::lock_guard<std::mutex> lock(mutex());
+
+    auto &d = loaded[directory];
+    if (d) {
+      return d;
+    }
+
+    std::vector<std::shared_ptr<const mapping>> files;
+    std::vector<markov::model> models;
+
+    for (const auto &f : {"female.first", "male.first", "all.last"}) {
+      auto m = std::make_shared<const mapping>(directory + "/" + f + ".mqn");
+      if (!m->valid()) {
+        return nullptr;
+      }
+
+      auto model = markov::model::map(m->data, m->size);
+      if (!model) {
+        return nullptr;
+      }
+
+      files.push_back(m);
+      models.push_back(*model);
+    }
+
+    auto rv = std::make_shared<dataset>(models[0], models[1], models[2]);
+    rv->files = files;
+
+    return d = rv;
+  }
+
+  /**\brief The compiled data set
+   *
+   * \returns The data set compiled into the programme, which is
+   *          empty if METAQUEST_NO_BUILTIN_NAMES is defined.
+   */
+  static std::shared_ptr<const dataset> builtin(void) {
+#if !defined(METAQUEST_NO_BUILTIN_NAMES)
+    static const auto d = std::make_shared<const dataset>(
+        data::female_first, data::male_first, data::all_last);
+#else
+    static const markov::model none(nullptr, 0, nullptr, 0);
+    static const auto d = std::make_shared<const dataset>(none, none, none);
+#endif
+    return d;
+  }
+
+  /**\brief The selected data set
+   *
+   * \returns The data set that new name generation contexts use.
+   */
+  static std::shared_ptr<const dataset> current(void) {
+    std::lock_guard<std::mutex> lock(mutex());
+    return selection();
+  }
+
+  /**\brief Select a data set
+   *
+   * Selects the data set that new name generation contexts use. This
+   * doesn't affect contexts that already exist, so do it at startup.
+   *
+   * \param[in] d The data set to use.
+   *
+   * \returns 'true' if the data set was selected.
+   */
+  static bool select(const std::shared_ptr<const dataset> &d) {
+    if (!d) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex());
+    selection() = d;
+    return true;
+  }
+
+protected:
+  /**\brief Mapped files that the models refer to. */
+  std::vector<std::shared_ptr<const mapping>> files;
+
+  static std::mutex &mutex(void) {
+    static std::mutex m;
+    return m;
+  }
+
+  static std::shared_ptr<const dataset> &selection(void) {
+    static std::shared_ptr<const dataset> s = builtin();
+    return s;
+  }
+};
+
 /**\brief Automatically-generated, American-sounding given name
  *
  * This template can be used to automatically generate American-ish
@@ -226,9 +535,9 @@ namespace american {
  *
  * \tparam T         The type used for single characters in names.
  * \tparam generator A class that can generate random names, e.g. a
- *                   variant of efgy::markov::chain.
+ *                   variant of markov::chain.
  */
-template <typename T = char, typename generator = efgy::markov::chain<T, 3>>
+template <typename T = char, typename generator = markov::chain<T>>
 class given : public name<T, generator> {
 public:
   /**\brief Base name type
@@ -251,27 +560,31 @@ public:
    * \param[in] female Whether the code should use the census
    *                   data for female names; Defaults to
    *                   'true'.
-   * \param[in] length The maximum length of the name. If the
-   *                   generated name is longer then a new one
-   *                   is generated.
+   * \param[in] length The maximum length of the name. Names
+   *                   are sampled under this bound directly,
+   *                   so there is no need to retry.
    */
   given(bool female = true, unsigned int length = 9)
+      : given(context<T, generator>::local(), female, length) {}
+
+  /**\brief Construct with context, gender and maximum length
+   *
+   * Like the other constructor, but uses the given context
+   * instead of the one of the current thread.
+   *
+   * \param[in] ctx    The context to generate the name with.
+   * \param[in] female Whether to use the female census data.
+   * \param[in] length The maximum length of the name.
+   */
+  given(context<T, generator> &ctx, bool female = true,
+        unsigned int length = 9)
       : parent("", parent::givenName) {
-    static typename generator::random PRNG(seed);
-    static generator femaleFirstNames(PRNG, data::female_first);
-    static generator maleFirstNames(PRNG, data::male_first);
-
-    while ((value.size() == 0) || (value.size() > length)) {
-      switch (PRNG() % 10) {
-      case 0:
-        (female ? maleFirstNames : femaleFirstNames) >> value;
-      default:
-        (female ? femaleFirstNames : maleFirstNames) >> value;
-      }
-    }
+    (female ? ctx.femaleFirstNames : ctx.maleFirstNames).sample(value, length);
 
-    std::transform(value.begin() + 1, value.end(), value.begin() + 1,
-                   [](char a) -> char { return std::tolower(a); });
+    if (value.size() > 1) {
+      std::transform(value.begin() + 1, value.end(), value.begin() + 1,
+                     [](char a) -> char { return std::tolower(a); });
+    }
   }
 };
 
@@ -282,9 +595,9 @@ public:
  *
  * \tparam T         The type used for single characters in names.
  * \tparam generator A class that can generate random names, e.g. a
- *                   variant of efgy::markov::chain.
+ *                   variant of markov::chain.
  */
-template <typename T = char, typename generator = efgy::markov::chain<T, 3>>
+template <typename T = char, typename generator = markov::chain<T>>
 class family : public name<T, generator> {
 public:
   /**\copydoc given::name */
@@ -299,20 +612,26 @@ public:
    * limit on the length of that name so as to make sure the
    * names don't get too unwieldy.
    *
-   * \param[in] length The maximum length of the name. If the
-   *                   generated name is longer then a new one
-   *                   is generated.
+   * \param[in] length The maximum length of the name. Names
+   *                   are sampled under this bound directly,
+   *                   so there is no need to retry.
    */
-  family(unsigned int length = 9) : parent("", parent::familyName) {
-    static typename generator::random PRNG(seed);
-    static generator lastNames(PRNG, data::all_last);
+  family(unsigned int length = 9)
+      : family(context<T, generator>::local(), length) {}
 
-    while ((value.size() == 0) || (value.size() > length)) {
-      lastNames >> value;
-    }
+  /**\brief Construct with context and maximum length
+   *
+   * \param[in] ctx    The context to generate the name with.
+   * \param[in] length The maximum length of the name.
+   */
+  family(context<T, generator> &ctx, unsigned int length = 9)
+      : parent("", parent::familyName) {
+    ctx.lastNames.sample(value, length);
 
-    std::transform(value.begin() + 1, value.end(), value.begin() + 1,
-                   [](char a) -> char { return std::tolower(a); });
+    if (value.size() > 1) {
+      std::transform(value.begin() + 1, value.end(), value.begin() + 1,
+                     [](char a) -> char { return std::tolower(a); });
+    }
   }
 };
 
@@ -323,9 +642,9 @@ public:
  *
  * \tparam T         The type used for single characters in names.
  * \tparam generator A class that can generate random names, e.g. a
- *                   variant of efgy::markov::chain.
+ *                   variant of markov::chain.
  */
-template <typename T = char, typename generator = efgy::markov::chain<T, 3>>
+template <typename T = char, typename generator = markov::chain<T>>
 class proper : public metaquest::name::proper<T, generator> {
 public:
   /**\copydoc given::name */
@@ -341,24 +660,111 @@ public:
    * \param[in] female Whether the code should use the census
    *                   data for female names; Defaults to
    *                   'true'.
-   * \param[in] length The maximum length of the name. If the
-   *                   generated name is longer then a new one
-   *                   is generated.
+   * \param[in] length The maximum length of each of the names.
+   * \param[in] names  The maximum number of given and family
+   *                   names, each; this keeps the cost of a
+   *                   name bounded.
    */
-  proper(bool female = true, unsigned int length = 9) {
-    static typename generator::random PRNG(seed);
+  proper(bool female = true, unsigned int length = 9, unsigned int names = 3)
+      : proper(context<T, generator>::local(), female, length, names) {}
 
+  /**\brief Construct with context, gender and maximum length
+   *
+   * \param[in] ctx    The context to generate the name with.
+   * \param[in] female Whether to use the female census data.
+   * \param[in] length The maximum length of each of the names.
+   * \param[in] names  The maximum number of given and family
+   *                   names, each.
+   */
+  proper(context<T, generator> &ctx, bool female = true,
+         unsigned int length = 9, unsigned int names = 3) {
+    unsigned int n = 0;
     do {
-      given<T, generator> f(female, length);
+      given<T, generator> f(ctx, female, length);
       parent::push_back(f);
-    } while ((PRNG() % 10) == 0);
+    } while ((++n < names) && ((ctx.PRNG() % 10) == 0));
 
+    n = 0;
     do {
-      family<T, generator> l(length);
+      family<T, generator> l(ctx, length);
       parent::push_back(l);
-    } while ((PRNG() % 10) == 0);
+    } while ((++n < names) && ((ctx.PRNG() % 10) == 0));
   }
 };
+
+/**\brief Name generation context
+ *
+ * Holds the PRNG and the name generators used by american::given,
+ * american::family and american::proper. A context must not be
+ * shared between threads, so create one per thread or per game;
+ * the constructors that don't take a context use one that is
+ * local to the calling thread.
+ *
+ * \tparam T         The type used for single characters in names.
+ * \tparam generator A class that can generate random names, e.g. a
+ *                   variant of markov::chain.
+ */
+template <typename T = char, typename generator = markov::chain<T>>
+class context {
+public:
+  /**\brief Construct with seed and data set
+   *
+   * \param[in] pSeed   Seed for the context's PRNG.
+   * \param[in] pSource The data set to generate names from.
+   */
+  context(unsigned long pSeed = std::random_device()(),
+          std::shared_ptr<const dataset> pSource = dataset::current())
+      : PRNG(pSeed), source(pSource),
+        femaleFirstNames(PRNG, source->femaleFirstSamplers),
+        maleFirstNames(PRNG, source->maleFirstSamplers),
+        lastNames(PRNG, source->allLastSamplers) {}
+
+  context(const context &) = delete;
+  context &operator=(const context &) = delete;
+
+  /**\brief Context of the current thread
+   *
+   * Each thread gets its own context, which is seeded with the
+   * default seed and the thread's ID.
+   *
+   * \returns The context of the calling thread.
+   */
+  static context &local(void) {
+    thread_local context ctx(
+        seed ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return ctx;
+  }
+
+  /**\brief Generate a batch of names
+   *
+   * Writes 'n' proper names to 'out'; the gender of each name is
+   * picked at random.
+   *
+   * \param[out] out    Where to write the names to.
+   * \param[in]  n      The number of names to generate.
+   * \param[in]  length The maximum length of each of the names.
+   * \param[in]  names  The maximum number of given and family
+   *                    names, each.
+   *
+   * \returns The output iterator past the last generated name.
+   */
+  template <typename iterator>
+  iterator operator()(iterator out, std::size_t n, unsigned int length = 9,
+                      unsigned int names = 3) {
+    for (std::size_t i = 0; i < n; i++) {
+      *out = proper<T, generator>(*this, PRNG() % 2, length, names);
+      ++out;
+    }
+
+    return out;
+  }
+
+  typename generator::random PRNG;
+  const std::shared_ptr<const dataset> source;
+  generator femaleFirstNames;
+  generator maleFirstNames;
+  generator lastNames;
+};
 }
 }
 }
@@ -19,7 +19,10 @@
 #include <ef.gy/json.h>
 
 #include <metaquest/name.h>
+#include <metaquest/save.h>
 
+#include <atomic>
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <map>
@@ -31,6 +34,20 @@
 namespace metaquest {
 template <typename T> using slots = std::map<std::string, T>;
 
+/**\brief Revision counter
+ *
+ * Shared by everything that keeps a revision - objects and inventories - so
+ * revisions are unique across all of them.
+ */
+class revisions {
+public:
+  /**\brief A revision that hasn't been used before. */
+  static std::uint64_t next(void) {
+    static std::atomic<std::uint64_t> counter(0);
+    return ++counter;
+  }
+};
+
 /**\brief A game object
  *
  * The base class for items, characters, etc. Provides common properties,
@@ -43,6 +60,8 @@ template <typename T = long, typename C = char> class object {
 public:
   using base = T;
 
+  object(void) : stamp(next()) {}
+
   virtual ~object(void) {}
 
   /**\brief Object name
@@ -97,6 +116,7 @@ public:
         }
       }
     }
+    touch();
     return attribute[s] = n;
   }
 
@@ -155,6 +175,7 @@ public:
       slots[data.first] = data.second.asNumber();
     }
 
+    touch();
     return true;
   }
 
@@ -176,6 +197,76 @@ public:
     return rv;
   }
 
+  /**\brief Write to save data
+   *
+   * Writes the object as a save data object; the members are written by
+   * fields(), which derived classes extend.
+   *
+   * \param[out] out Where to write the object to.
+   */
+  void write(save::writer &out) const {
+    out.beginObject();
+    fields(out);
+    out.end();
+  }
+
+  /**\brief Read from save data
+   *
+   * Reads an object written by write(); each member is handed to field().
+   *
+   * \param[in] in Where to read the object from.
+   *
+   * \returns 'true' if the object was read successfully.
+   */
+  virtual bool read(save::reader &in) {
+    std::string k;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    touch();
+
+    while (in.key(k)) {
+      if (!field(k, in)) {
+        return false;
+      }
+    }
+
+    return in.good();
+  }
+
+  /**\brief Fingerprint of the saved state
+   *
+   * Changes whenever anything that write() saves changes, and only then, so
+   * comparing fingerprints tells whether the object needs to be saved again.
+   *
+   * \returns A digest of the object's save data.
+   */
+  std::uint64_t fingerprint(void) const {
+    save::digest d;
+    write(d);
+    return d.value();
+  }
+
+  /**\brief Revision of the object
+   *
+   * Changes whenever the object is changed with set(), add(), load() or
+   * read(); code that changes the members directly needs to call touch().
+   * Revisions are unique across all objects, so comparing revisions is a
+   * cheap way to tell whether something built from an object is still
+   * current, without looking at the object's contents.
+   *
+   * \returns The object's current revision.
+   */
+  std::uint64_t revision(void) const { return stamp; }
+
+  /**\brief Mark the object as changed
+   *
+   * Gives the object a new revision.
+   */
+  void touch(void) { stamp = next(); }
+
   slots<T> slots;
 
   /**\brief Attribute generation functions
@@ -190,6 +281,56 @@ public:
    * Maps basic attributes to their proper values.
    */
   std::map<std::string, T> attribute;
+
+protected:
+  /**\brief The current revision. */
+  std::uint64_t stamp;
+
+  /**\brief A revision that hasn't been used before. */
+  static std::uint64_t next(void) { return revisions::next(); }
+
+  virtual void fields(save::writer &out) const {
+    out.key("name");
+    name.write(out);
+
+    out.key("attributes");
+    out.beginObject();
+    for (auto &attrib : attribute) {
+      out.key(attrib.first);
+      out.number(attrib.second);
+    }
+    out.end();
+
+    out.key("slots");
+    out.beginObject();
+    for (auto &slot : slots) {
+      out.key(slot.first);
+      out.number(slot.second);
+    }
+    out.end();
+  }
+
+  virtual bool field(const std::string &key, save::reader &in) {
+    std::string k;
+
+    if (key == "name") {
+      return name.read(in);
+    } else if (key == "attributes") {
+      in.beginObject();
+      while (in.key(k)) {
+        in.number(attribute[k]);
+      }
+    } else if (key == "slots") {
+      in.beginObject();
+      while (in.key(k)) {
+        in.number(slots[k]);
+      }
+    } else {
+      in.skip();
+    }
+
+    return in.good();
+  }
 };
 
 template <typename T> using objects = std::vector<object<T> *>;
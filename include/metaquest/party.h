@@ -54,7 +54,7 @@ public:
     party p;
 
     for (const auto o : json("member").asArray()) {
-      character c = game.generateCharacter();
+      character c = game.blankCharacter();
 
       if (c.load(o)) {
         p.push_back(c);
@@ -68,6 +68,34 @@ public:
     return p;
   }
 
+  template <typename G> static party read(G &game, save::reader &in) {
+    party p;
+    std::string k;
+
+    if (!in.beginObject()) {
+      return p;
+    }
+
+    while (in.key(k)) {
+      if (k == "member") {
+        in.beginArray();
+        while (in.next()) {
+          character c = game.blankCharacter();
+
+          if (c.read(in)) {
+            p.push_back(c);
+          }
+        }
+      } else if (k == "inventory") {
+        p.inventory.read(in);
+      } else {
+        in.skip();
+      }
+    }
+
+    return p;
+  }
+
   virtual efgy::json::json json(void) const {
     efgy::json::json rv;
 
@@ -81,6 +109,22 @@ public:
     return rv;
   }
 
+  void write(save::writer &out) const {
+    out.beginObject();
+
+    out.key("member");
+    out.beginArray();
+    for (auto &ch : *this) {
+      ch.write(out);
+    }
+    out.end();
+
+    out.key("inventory");
+    inventory.write(out);
+
+    out.end();
+  }
+
   items<base> inventory;
 
 protected:
@@ -0,0 +1,405 @@
+/**\file
+ * \brief Remote interaction
+ *
+ * An interaction backend for games that are played from somewhere else, e.g.
+ * over HTTP. Instead of reading key presses, the game posts a question with a
+ * list of options and hands back control until it's answered by index.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_REMOTE_H)
+#define METAQUEST_REMOTE_H
+
+#include <metaquest/ai.h>
+#include <metaquest/game.h>
+#include <metaquest/logbook.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace metaquest {
+namespace interact {
+namespace remote {
+/**\brief A question for the player */
+class prompt {
+public:
+  /**\brief Who is asking, or what the question is about. */
+  std::string title;
+
+  std::vector<std::string> options;
+
+  /**\brief Details to show along with the question, if any. */
+  std::map<std::string, std::string> data;
+
+  efgy::json::json json(void) const {
+    efgy::json::json rv;
+
+    rv("title") = title;
+
+    auto &os = rv("options").toArray();
+    for (const auto &o : options) {
+      os.push(o);
+    }
+
+    if (!data.empty()) {
+      auto &ds = rv("data").toObject();
+      for (const auto &d : data) {
+        ds(d.first) = d.second;
+      }
+    }
+
+    return rv;
+  }
+};
+
+/**\brief Remote interaction
+ *
+ * The game runs on a fiber, or anything else that can hand back control and
+ * be resumed later: query() posts the question and calls yield until it's
+ * answered with answer(), after which whoever answered resumes the game. In
+ * the meantime, status() shows the party rows as of the last drawUI(), the
+ * current question and what was logged since the previous one.
+ *
+ * Nothing is locked, so the game and the calls that answer or look at it
+ * need to take turns, e.g. by running on the same asio strand.
+ *
+ * Menus are not nested, as they are on a terminal: submenu entries are listed
+ * with their full path, e.g. "Magic/Fire".
+ *
+ * \tparam AI The AI for characters that the player doesn't control.
+ */
+template <template <typename> class AI = ai::random> class base {
+public:
+  base(void) : ai(*this), asked(0), seen(0), open(true), over(false) {}
+
+  ~base(void) { close(); }
+
+  AI<base<AI>> ai;
+  metaquest::logbook logbook;
+
+  /**\brief Hand back control
+   *
+   * Called by the game while a question is open, e.g. to yield its fiber;
+   * returns once the game has been resumed. Without it, questions can't be
+   * answered, and are treated as if the game was closed.
+   */
+  std::function<void(void)> yield;
+
+  /**\brief Answer the current question
+   *
+   * \param[in] question The number of the question, as shown by status().
+   * \param[in] option   The index of the chosen option.
+   *
+   * \returns 'true' if the question was still open and the option is valid.
+   */
+  bool answer(std::size_t question, std::size_t option) {
+    if (!pending || (question != asked) || chosen ||
+        (option >= pending->options.size())) {
+      return false;
+    }
+
+    chosen = option;
+    return true;
+  }
+
+  /**\brief End the game
+   *
+   * Open and future questions are answered so that the player quits, or
+   * cancels where quitting isn't an option, once the game is resumed.
+   */
+  void close(void) { open = false; }
+
+  /**\brief Mark the game as over
+   *
+   * Called by the game once it has ended.
+   */
+  void finish(void) {
+    over = true;
+    pending.reset();
+  }
+
+  bool finished(void) const { return over; }
+
+  /**\brief Is the game waiting for an answer? */
+  bool waiting(void) const { return pending && !chosen; }
+
+  /**\brief Current state, for the player
+   *
+   * \returns The party rows, the current question and its number, and the
+   *          log entries since the last question was answered.
+   */
+  efgy::json::json status(void) const {
+    efgy::json::json rv;
+
+    rv("state") = over ? "over" : (pending && !chosen) ? "waiting" : "busy";
+    rv("question") = efgy::json::json::numeric(asked);
+    rv("parties") = parties;
+
+    if (pending && !chosen) {
+      rv("prompt") = pending->json();
+    }
+
+    auto &ls = rv("log").toArray();
+    for (std::size_t i = std::max(seen, logbook.first()); i < logbook.size();
+         i++) {
+      ls.push(logbook[i].json());
+    }
+
+    return rv;
+  }
+
+  void clear(void) {}
+
+  /**\brief Take down the party rows
+   *
+   * The rows are kept as JSON, so status() can show them without looking at
+   * the game.
+   */
+  template <typename G> void drawUI(G &game) {
+    efgy::json::json ps;
+    std::string name;
+
+    ps.toArray();
+    for (const auto &party : game.parties) {
+      efgy::json::json rows;
+
+      rows.toArray();
+      for (const auto &p : party) {
+        efgy::json::json row;
+
+        name.assign(p.name.full());
+        row("name") = name;
+
+        auto &hp = row("hp").toArray();
+        hp.push(efgy::json::json::numeric(p["HP/Current"]));
+        hp.push(efgy::json::json::numeric(p["HP/Total"]));
+
+        auto &mp = row("mp").toArray();
+        mp.push(efgy::json::json::numeric(p["MP/Current"]));
+        mp.push(efgy::json::json::numeric(p["MP/Total"]));
+
+        rows.push(row);
+      }
+
+      ps.push(rows);
+    }
+
+    parties = ps;
+  }
+
+  template <typename G>
+  bool
+  log(const G &game, const std::string &description,
+      const metaquest::character<typename G::num> &source,
+      const std::vector<metaquest::character<typename G::num> *> &targets) {
+    std::vector<metaquest::logbook::position> ts;
+
+    for (const auto &t : targets) {
+      ts.push_back({game.partyOf(*t), game.positionOf(*t)});
+    }
+
+    logbook.push(
+        {description, {game.partyOf(source), game.positionOf(source)}, ts});
+
+    return true;
+  }
+
+  void log(std::string log) { logbook.push(log); }
+
+  template <typename G>
+  bool
+  action(const G &game, const std::string &description,
+         const metaquest::character<typename G::num> &source,
+         const std::vector<metaquest::character<typename G::num> *> &targets) {
+    return log(game, description, source, targets);
+  }
+
+  bool display(const std::string &title,
+               const std::map<std::string, std::string> &data,
+               std::size_t = 8) {
+    ask({title, {"OK"}, data});
+    return true;
+  }
+
+  template <typename T, typename G>
+  std::string query(const G &game, const metaquest::character<T> &source,
+                    const std::vector<std::string> &pList,
+                    std::size_t indent = 4, std::string carry = "") {
+    if (game.useAI(source)) {
+      return ai.query(game, source, pList, indent, carry);
+    }
+
+    std::vector<std::string> options;
+    for (const auto &o : pList) {
+      options.push_back(carry + o);
+    }
+
+    const auto a = ask({std::string(source.name.display()), options, {}});
+    if (a) {
+      return options[*a];
+    }
+
+    const auto quit = std::find(options.begin(), options.end(), "Quit/Yes");
+    return quit != options.end() ? *quit : "Cancel";
+  }
+
+  template <typename T, typename G>
+  std::optional<std::vector<metaquest::character<T> *>>
+  query(G &game, const metaquest::character<T> &source,
+        std::vector<metaquest::character<T> *> &candidates,
+        std::size_t indent = 4) {
+    if (game.useAI(source)) {
+      return ai.query(game, source, candidates, indent);
+    }
+
+    if (candidates.size() == 1) {
+      return candidates;
+    }
+
+    std::vector<std::string> options;
+    for (const auto &c : candidates) {
+      options.push_back(std::string(c->name.display()));
+    }
+    options.push_back("Cancel");
+
+    const auto a = ask({std::string(source.name.display()), options, {}});
+    if (!a || (*a >= candidates.size())) {
+      return std::optional<std::vector<metaquest::character<T> *>>();
+    }
+
+    return std::vector<metaquest::character<T> *>{candidates[*a]};
+  }
+
+  virtual bool load(efgy::json::json json) {
+    if (json("log").isArray()) {
+      logbook.load(json("log"));
+    }
+    if (json("log-start").isNumber()) {
+      logbook.rebase(json("log-start").asNumber());
+    }
+    return true;
+  }
+
+  virtual efgy::json::json json(void) const {
+    efgy::json::json rv;
+
+    rv("log") = logbook.json();
+    rv("log-start") = efgy::json::json::numeric(logbook.first());
+
+    return rv;
+  }
+
+  virtual bool read(save::reader &in) {
+    std::string k;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    while (in.key(k)) {
+      if (k == "log") {
+        logbook.read(in);
+      } else if (k == "log-start") {
+        std::size_t start;
+        if (in.number(start)) {
+          logbook.rebase(start);
+        }
+      } else {
+        in.skip();
+      }
+    }
+
+    return in.good();
+  }
+
+  virtual void write(save::writer &out) const { write(out, logbook); }
+
+  /**\brief Saved interaction state.
+   *
+   * A copy of the logbook, as with the terminal.
+   */
+  class snapshot {
+  public:
+    metaquest::logbook log;
+
+    void write(save::writer &out) const { base::write(out, log); }
+  };
+
+  snapshot capture(void) const { return {logbook}; }
+
+protected:
+  /**\brief The current question, if the game is waiting for one. */
+  std::optional<prompt> pending;
+
+  /**\brief The answer to the current question, once there is one. */
+  std::optional<std::size_t> chosen;
+
+  /**\brief The number of questions asked so far. */
+  std::size_t asked;
+
+  /**\brief Log entries the player has been shown. */
+  std::size_t seen;
+
+  /**\brief Is anyone still playing? */
+  bool open;
+
+  bool over;
+
+  /**\brief Party rows, as of the last drawUI(). */
+  efgy::json::json parties;
+
+  /**\brief Ask a question
+   *
+   * Posts the question, then hands back control until it's answered.
+   *
+   * \param[in] p The question.
+   *
+   * \returns The index of the chosen option; nothing if the game was closed.
+   */
+  std::optional<std::size_t> ask(prompt &&p) {
+    if (!open || !yield) {
+      return std::optional<std::size_t>();
+    }
+
+    pending = std::move(p);
+    chosen.reset();
+    asked++;
+
+    while (!chosen && open) {
+      yield();
+    }
+
+    const auto rv = chosen;
+
+    pending.reset();
+    chosen.reset();
+    seen = logbook.size();
+
+    return rv;
+  }
+
+  static void write(save::writer &out, const metaquest::logbook &log) {
+    out.beginObject();
+    out.key("log");
+    log.write(out);
+    out.key("log-start");
+    out.number(log.first());
+    out.end();
+  }
+};
+}
+}
+}
+
+#endif
@@ -0,0 +1,90 @@
+/**\file
+ * \brief Single-producer, single-consumer queue
+ *
+ * A bounded queue for handing data from one thread to exactly one other
+ * thread without locks, e.g. from the game's thread to the terminal's
+ * refresher thread.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_RING_H)
+#define METAQUEST_RING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace metaquest {
+/**\brief Lock-free ring buffer
+ *
+ * Only one thread may push() and only one other thread may pop(). Neither
+ * ever waits for the other; push() fails if the ring is full and pop() fails
+ * if it is empty.
+ *
+ * \tparam T    The element type; needs to be move constructible.
+ * \tparam size The number of slots; the ring holds one element less.
+ */
+template <typename T, std::size_t size> class ring {
+public:
+  ring(void) : head(0), tail(0) {}
+
+  ring(const ring &) = delete;
+  ring &operator=(const ring &) = delete;
+
+  /**\brief Add an element
+   *
+   * \param[in] v The new element; only moved from on success.
+   *
+   * \returns 'true' if there was room for the element.
+   */
+  bool push(T &&v) {
+    const std::size_t t = tail.load(std::memory_order_relaxed);
+    const std::size_t n = (t + 1) % size;
+
+    if (n == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    buffer[t].emplace(std::move(v));
+    tail.store(n, std::memory_order_release);
+    return true;
+  }
+
+  /**\brief Take the oldest element
+   *
+   * \returns The element, if there was one.
+   */
+  std::optional<T> pop(void) {
+    const std::size_t h = head.load(std::memory_order_relaxed);
+
+    if (h == tail.load(std::memory_order_acquire)) {
+      return std::optional<T>();
+    }
+
+    std::optional<T> v(std::move(buffer[h]));
+    buffer[h].reset();
+    head.store((h + 1) % size, std::memory_order_release);
+    return v;
+  }
+
+protected:
+  std::array<std::optional<T>, size> buffer;
+
+  /**\brief Next slot to pop; only written by the consumer. */
+  alignas(64) std::atomic<std::size_t> head;
+
+  /**\brief Next slot to push; only written by the producer. */
+  alignas(64) std::atomic<std::size_t> tail;
+};
+}
+
+#endif
@@ -24,7 +24,8 @@ namespace metaquest {
 namespace rules {
 namespace simple {
 static long solve(double a, double b, double c) {
-  static std::mt19937 rng = std::mt19937(std::random_device()());
+  static thread_local std::mt19937 rng =
+      std::mt19937(std::random_device()());
   return 5 * std::sqrt(a * b / c) * (0.95 + (rng() % 100) / 1000.0);
 }
 
@@ -94,10 +95,11 @@ static std::string pass(objects<long> &source, objects<long> &target) {
 using action = metaquest::action<long>;
 
 static metaquest::item<long> weapon(const std::string &name) {
-  static std::mt19937 rng = std::mt19937(std::random_device()());
-  metaquest::item<long> r;
+  static thread_local std::mt19937 rng =
+      std::mt19937(std::random_device()());
+  metaquest::item<long> r(
+      metaquest::item<long>::kind::get({name, "", {{"Weapon", 1}}}));
 
-  r.usedSlots["Weapon"] = 1;
   r.attribute["Damage"] = 5 + rng() % 10;
 
   r.name = name::simple<>(name);
@@ -106,15 +108,31 @@ static metaquest::item<long> weapon(const std::string &name) {
   return r;
 }
 
-static metaquest::character<long> character(long points = 0) {
-  static std::mt19937 rng = std::mt19937(std::random_device()());
+static metaquest::character<long> blank(void) {
   metaquest::character<long> c;
 
+  c.slots = {{"Weapon", 1}, {"Trinket", 1}};
+
+  c.function["Level"] = getLevel;
+  c.function["HP/Total"] = getHPTotal;
+  c.function["MP/Total"] = getMPTotal;
+
+  c.function["Attack"] = getAttack;
+  c.function["Defence"] = getDefence;
+
+  c.actions = {"Attack", "Skill/Heal", "Pass"};
+
+  return c;
+}
+
+static metaquest::character<long> character(long points = 0) {
+  static thread_local std::mt19937 rng =
+      std::mt19937(std::random_device()());
+  metaquest::character<long> c = blank();
+
   metaquest::name::american::proper<> cname(rng() % 2);
   c.name = cname;
 
-  c.slots = {{"Weapon", 1}, {"Trinket", 1}};
-
   c.equipment.push_back(weapon("Sword"));
 
   c.attribute["Experience"] = points;
@@ -122,17 +140,10 @@ static metaquest::character<long> character(long points = 0) {
   c.attribute["Endurance"] = 1 + rng() % 100;
   c.attribute["Magic"] = 100 - c.attribute["Endurance"];
 
-  c.function["Level"] = getLevel;
-  c.function["HP/Total"] = getHPTotal;
-  c.function["MP/Total"] = getMPTotal;
-
-  c.function["Attack"] = getAttack;
-  c.function["Defence"] = getDefence;
-
   c.attribute["HP/Current"] = c["HP/Total"];
   c.attribute["MP/Current"] = c["MP/Total"];
 
-  c.actions = {"Attack", "Skill/Heal", "Pass"};
+  c.touch();
 
   return c;
 }
@@ -158,8 +169,11 @@ public:
     return simple::character(points);
   }
 
+  virtual character blankCharacter(void) { return simple::blank(); }
+
   virtual party generateParty(long members, long points) {
-    static std::mt19937 rng = std::mt19937(std::random_device()());
+    static thread_local std::mt19937 rng =
+        std::mt19937(std::random_device()());
     party p;
 
     if ((parent::parties.size() > 0) && (points == 0)) {
@@ -223,6 +237,8 @@ public:
         xp += c["Experience"];
       }
 
+      p.inventory.touch();
+
       xp /= p.size();
       if (xp == 0) {
         xp = 1;
@@ -0,0 +1,322 @@
+/**\file
+ * \brief Binary save format
+ *
+ * A compact binary encoding of save data, meant to be written in one pass and
+ * read straight out of a memory-mapped file.
+ *
+ * The data starts with the magic "MQSV" and a format version, followed by a
+ * single value. Values are tagged with a byte: 'o' starts an object, 'a' an
+ * array and 'e' ends either; 'i' precedes a zigzag-encoded varint and 's' a
+ * varint length and that many bytes of string data. Each member of an object
+ * starts with 'k' and a varint: 0 for a new key, followed by its length and
+ * data, or the 1-based index of a key that was used before.
+ *
+ * This is still a tagged stream that is parsed on load, just a much cheaper
+ * one than JSON; it is not a layout that could be used in place.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_SAVE_BINARY_H)
+#define METAQUEST_SAVE_BINARY_H
+
+#include <metaquest/save.h>
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace metaquest {
+namespace save {
+/**\brief Binary save format
+ *
+ * Writer and reader for the binary save format.
+ */
+namespace binary {
+/**\brief Format version
+ *
+ * Increase this whenever the encoding changes in an incompatible way.
+ */
+static const std::uint64_t version = 1;
+
+/**\brief Binary save writer
+ *
+ * Writes save data in the binary format to a buffered output.
+ */
+class writer : public save::writer {
+public:
+  /**\brief Construct with output
+   *
+   * Writes the magic and format version right away.
+   *
+   * \param[out] pOut Where to write the data to.
+   */
+  writer(output &pOut) : out(pOut) {
+    out.write("MQSV", 4);
+    varint(version);
+  }
+
+  virtual void beginObject(void) { out.write('o'); }
+  virtual void beginArray(void) { out.write('a'); }
+  virtual void end(void) { out.write('e'); }
+
+  virtual void key(const std::string &k) {
+    out.write('k');
+
+    const auto it = keys.find(k);
+    if (it != keys.end()) {
+      varint(it->second);
+    } else {
+      const std::uint64_t id = keys.size() + 1;
+      keys[k] = id;
+      varint(0);
+      varint(k.size());
+      out.write(k);
+    }
+  }
+
+  virtual void number(long n) {
+    out.write('i');
+    varint((std::uint64_t(n) << 1) ^ std::uint64_t(n >> 63));
+  }
+
+  virtual void string(std::string_view s) {
+    out.write('s');
+    varint(s.size());
+    out.write(s);
+  }
+
+  virtual bool good(void) const { return out.good(); }
+
+protected:
+  output &out;
+
+  /**\brief Keys that were written so far, and their indices. */
+  std::unordered_map<std::string, std::uint64_t> keys;
+
+  void varint(std::uint64_t v) {
+    while (v >= 0x80) {
+      out.write(char((v & 0x7f) | 0x80));
+      v >>= 7;
+    }
+    out.write(char(v));
+  }
+};
+
+/**\brief Binary save reader
+ *
+ * Reads save data in the binary format from memory, e.g. a memory-mapped
+ * file. Strings are only copied when they're requested.
+ */
+class reader : public save::reader {
+public:
+  /**\brief Construct with data
+   *
+   * Checks the magic and format version; the reader fails if these don't
+   * match.
+   *
+   * \param[in] pData Start of the data.
+   * \param[in] pSize Size of the data, in bytes.
+   */
+  reader(const char *pData, std::size_t pSize)
+      : b(pData), p(pData), e(pData + pSize), ok(is(pData, pSize)) {
+    std::uint64_t v;
+
+    if (ok) {
+      p += 4;
+      ok = varint(v) && (v == version);
+    }
+  }
+
+  /**\brief Is this binary save data?
+   *
+   * \param[in] data Start of the data.
+   * \param[in] size Size of the data, in bytes.
+   *
+   * \returns 'true' if the data starts with the binary save magic.
+   */
+  static bool is(const char *data, std::size_t size) {
+    return (size >= 4) && (std::memcmp(data, "MQSV", 4) == 0);
+  }
+
+  virtual enum kind peek(void) {
+    if (!ok || (p >= e)) {
+      return end;
+    }
+
+    switch (*p) {
+    case 'o':
+      return object;
+    case 'a':
+      return array;
+    case 'i':
+      return integer;
+    case 's':
+      return text;
+    default:
+      return end;
+    }
+  }
+
+  virtual bool beginObject(void) { return tag('o'); }
+
+  virtual bool key(std::string &k) {
+    if (ok && (p < e) && (*p == 'e')) {
+      p++;
+      return false;
+    }
+
+    std::uint64_t id;
+    if (!tag('k') || !varint(id)) {
+      return false;
+    }
+
+    if (id == 0) {
+      std::string_view s;
+      if (!view(s)) {
+        return false;
+      }
+      keys.emplace_back(s);
+    } else if (id > keys.size()) {
+      return ok = false;
+    }
+
+    k.assign(keys[id == 0 ? keys.size() - 1 : id - 1]);
+    return true;
+  }
+
+  virtual bool beginArray(void) { return tag('a'); }
+
+  virtual bool next(void) {
+    if (ok && (p < e) && (*p == 'e')) {
+      p++;
+      return false;
+    }
+
+    return ok && (p < e);
+  }
+
+  virtual bool number(long &n) {
+    std::uint64_t v;
+    if (!tag('i') || !varint(v)) {
+      return false;
+    }
+
+    n = long((v >> 1) ^ (~(v & 1) + 1));
+    return true;
+  }
+
+  virtual bool string(std::string &s) {
+    std::string_view v;
+    if (!tag('s') || !view(v)) {
+      return false;
+    }
+
+    s.assign(v);
+    return true;
+  }
+
+  virtual bool skip(void) { return skip(0); }
+  virtual bool good(void) const { return ok; }
+
+  /**\brief Bytes read so far
+   *
+   * Several saves may follow each other in the same data; this is where the
+   * next one starts after the reader has read a complete value.
+   *
+   * \returns The number of bytes read, including the magic and version.
+   */
+  std::size_t consumed(void) const { return p - b; }
+
+protected:
+  const char *b;
+  const char *p;
+  const char *e;
+  bool ok;
+
+  /**\brief Keys read so far; these point into the data. */
+  std::vector<std::string_view> keys;
+
+  /**\brief Skip a value
+   *
+   * \param[in] depth How many objects and arrays the value is nested in.
+   *
+   * \returns 'true' if the value was skipped; fails past maxDepth.
+   */
+  bool skip(std::size_t depth) {
+    std::string k;
+
+    if (depth >= maxDepth) {
+      return ok = false;
+    }
+
+    switch (peek()) {
+    case object:
+      beginObject();
+      while (key(k) && skip(depth + 1)) {
+      }
+      break;
+    case array:
+      beginArray();
+      while (next() && skip(depth + 1)) {
+      }
+      break;
+    case integer: {
+      long n;
+      number(n);
+      break;
+    }
+    case text: {
+      std::string_view v;
+      tag('s') && view(v);
+      break;
+    }
+    case end:
+      ok = false;
+    }
+
+    return ok;
+  }
+
+  bool tag(char t) {
+    if (!ok || (p >= e) || (*p != t)) {
+      return ok = false;
+    }
+    p++;
+    return true;
+  }
+
+  bool varint(std::uint64_t &v) {
+    v = 0;
+    for (unsigned int shift = 0; ok && (p < e) && (shift < 64); shift += 7) {
+      const std::uint8_t b = *p++;
+      v |= std::uint64_t(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) {
+        return true;
+      }
+    }
+    return ok = false;
+  }
+
+  bool view(std::string_view &s) {
+    std::uint64_t size;
+    if (!varint(size) || (size > std::uint64_t(e - p))) {
+      return ok = false;
+    }
+    s = std::string_view(p, size);
+    p += size;
+    return true;
+  }
+};
+}
+}
+}
+
+#endif
@@ -0,0 +1,502 @@
+/**\file
+ * \brief JSON save format
+ *
+ * Writes save data as JSON, directly to a buffered output rather than by way
+ * of a JSON document in memory. The result is the same as the json() methods
+ * of the game objects produce, so it can be loaded with their load() methods.
+ *
+ * Reading works the same way: values are parsed as they are requested, and
+ * integers are converted directly, without going through floating point.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_SAVE_JSON_H)
+#define METAQUEST_SAVE_JSON_H
+
+#include <metaquest/save.h>
+#include <metaquest/utf8.h>
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace metaquest {
+namespace save {
+/**\brief JSON save format
+ *
+ * Writer and reader for save data in JSON format.
+ */
+namespace json {
+/**\brief Streaming JSON writer
+ *
+ * Writes save data as compact JSON to a buffered output, as it comes in. Only
+ * needs to keep track of how deeply nested the current value is.
+ */
+class writer : public save::writer {
+public:
+  /**\brief Construct with output
+   *
+   * \param[out] pOut Where to write the data to.
+   */
+  writer(output &pOut) : out(pOut), member(false) {}
+
+  virtual void beginObject(void) { open('{'); }
+  virtual void beginArray(void) { open('['); }
+
+  virtual void end(void) {
+    if (!first.empty()) {
+      out.write(first.back().second);
+      first.pop_back();
+    }
+  }
+
+  virtual void key(const std::string &k) {
+    separate();
+    quote(k);
+    out.write(':');
+    member = true;
+  }
+
+  virtual void number(long n) {
+    char buffer[24];
+
+    separate();
+    const auto r = std::to_chars(buffer, buffer + sizeof(buffer), n);
+    out.write(buffer, r.ptr - buffer);
+  }
+
+  virtual void string(std::string_view s) {
+    separate();
+    quote(s);
+  }
+
+  virtual bool good(void) const { return out.good(); }
+
+protected:
+  output &out;
+
+  /**\brief Open objects and arrays
+   *
+   * For each object or array that is currently open, whether it's still
+   * empty, and the character that closes it.
+   */
+  std::vector<std::pair<bool, char>> first;
+
+  /**\brief Did a key just come before the current value? */
+  bool member;
+
+  void open(char c) {
+    separate();
+    out.write(c);
+    first.push_back({true, c == '{' ? '}' : ']'});
+  }
+
+  /**\brief Write separator
+   *
+   * Writes a comma before the value or key that is about to be written,
+   * unless it is the first one in its object or array, or the value of a
+   * key.
+   */
+  void separate(void) {
+    if (member) {
+      member = false;
+    } else if (!first.empty()) {
+      if (!first.back().first) {
+        out.write(',');
+      }
+      first.back().first = false;
+    }
+  }
+
+  void quote(std::string_view s) {
+    static const char hex[] = "0123456789abcdef";
+    std::size_t start = 0;
+
+    out.write('"');
+
+    for (std::size_t i = 0; i < s.size(); i++) {
+      const unsigned char c = s[i];
+      if ((c >= 0x20) && (c != '"') && (c != '\\')) {
+        continue;
+      }
+
+      out.write(s.substr(start, i - start));
+      start = i + 1;
+
+      switch (c) {
+      case '"':
+        out.write("\\\"", 2);
+        break;
+      case '\\':
+        out.write("\\\\", 2);
+        break;
+      case '\n':
+        out.write("\\n", 2);
+        break;
+      case '\t':
+        out.write("\\t", 2);
+        break;
+      default: {
+        const char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+        out.write(u, sizeof(u));
+      }
+      }
+    }
+
+    out.write(s.substr(start));
+    out.write('"');
+  }
+};
+
+/**\brief Streaming JSON reader
+ *
+ * Parses JSON save data from memory, e.g. a memory-mapped file, as it is read.
+ * Integers are parsed with std::from_chars; numbers with a fraction or an
+ * exponent, as written by older versions, are rounded to the nearest integer.
+ * 'true', 'false' and 'null' read as the numbers 1, 0 and 0.
+ */
+class reader : public save::reader {
+public:
+  /**\brief Construct with data
+   *
+   * \param[in] pData Start of the data.
+   * \param[in] pSize Size of the data, in bytes.
+   */
+  reader(const char *pData, std::size_t pSize)
+      : p(pData), e(pData + pSize), ok(pData != nullptr) {}
+
+  virtual enum kind peek(void) {
+    if (!space()) {
+      return end;
+    }
+
+    switch (*p) {
+    case '{':
+      return object;
+    case '[':
+      return array;
+    case '"':
+      return text;
+    case '}':
+    case ']':
+      return end;
+    default:
+      return integer;
+    }
+  }
+
+  virtual bool beginObject(void) { return open('{'); }
+
+  virtual bool key(std::string &k) {
+    if (!member('}')) {
+      return false;
+    }
+
+    return string(k) && space() && expect(':');
+  }
+
+  virtual bool beginArray(void) { return open('['); }
+
+  virtual bool next(void) { return member(']'); }
+
+  virtual bool number(long &n) {
+    if (!space()) {
+      return false;
+    }
+
+    if (literal("true")) {
+      n = 1;
+      return true;
+    } else if (literal("false") || literal("null")) {
+      n = 0;
+      return true;
+    }
+
+    const auto r = std::from_chars(p, e, n);
+    if (r.ec != std::errc()) {
+      return ok = false;
+    }
+
+    if ((r.ptr < e) &&
+        ((*r.ptr == '.') || (*r.ptr == 'e') || (*r.ptr == 'E'))) {
+      return real(n);
+    }
+
+    p = r.ptr;
+    return true;
+  }
+
+  virtual bool string(std::string &s) {
+    s.clear();
+
+    if (!space() || !expect('"')) {
+      return false;
+    }
+
+    while (p < e) {
+      const char *q = p;
+      while ((q < e) && (*q != '"') && (*q != '\\')) {
+        q++;
+      }
+      s.append(p, q - p);
+      p = q;
+
+      if (p >= e) {
+        break;
+      } else if (*p == '"') {
+        p++;
+        return true;
+      } else if (!escape(s)) {
+        return false;
+      }
+    }
+
+    return ok = false;
+  }
+
+  virtual bool skip(void) { return skip(0); }
+
+  virtual bool good(void) const { return ok; }
+
+protected:
+  const char *p;
+  const char *e;
+  bool ok;
+
+  /**\brief Skip a value
+   *
+   * \param[in] depth How many objects and arrays the value is nested in.
+   *
+   * \returns 'true' if the value was skipped; fails past maxDepth.
+   */
+  bool skip(std::size_t depth) {
+    std::string s;
+    long n;
+
+    if (depth >= maxDepth) {
+      return ok = false;
+    }
+
+    switch (peek()) {
+    case object:
+      beginObject();
+      while (key(s) && skip(depth + 1)) {
+      }
+      break;
+    case array:
+      beginArray();
+      while (next() && skip(depth + 1)) {
+      }
+      break;
+    case integer:
+      number(n);
+      break;
+    case text:
+      string(s);
+      break;
+    case end:
+      ok = false;
+    }
+
+    return ok;
+  }
+
+  /**\brief Open objects and arrays
+   *
+   * For each object or array that is currently open, whether no member or
+   * element has been read from it yet.
+   */
+  std::vector<bool> first;
+
+  /**\brief Skip whitespace
+   *
+   * \returns 'true' if there is more data after the whitespace.
+   */
+  bool space(void) {
+    while ((p < e) && ((*p == ' ') || (*p == '\n') || (*p == '\r') ||
+                       (*p == '\t'))) {
+      p++;
+    }
+    return ok && (p < e);
+  }
+
+  bool expect(char c) {
+    if (!ok || (p >= e) || (*p != c)) {
+      return ok = false;
+    }
+    p++;
+    return true;
+  }
+
+  bool literal(const char *l) {
+    const std::size_t size = std::strlen(l);
+    if ((std::size_t(e - p) < size) || (std::memcmp(p, l, size) != 0)) {
+      return false;
+    }
+    p += size;
+    return true;
+  }
+
+  bool open(char c) {
+    if (!space() || !expect(c)) {
+      return false;
+    }
+    first.push_back(true);
+    return true;
+  }
+
+  /**\brief Go to next member or element
+   *
+   * \param[in] close The character that closes the current object or array.
+   *
+   * \returns 'true' if there is another member or element.
+   */
+  bool member(char close) {
+    if (!space() || first.empty()) {
+      return ok = false;
+    }
+
+    if (*p == close) {
+      p++;
+      first.pop_back();
+      return false;
+    }
+
+    if (first.back()) {
+      first.back() = false;
+      return true;
+    }
+
+    return expect(',') && space();
+  }
+
+  /**\brief Parse a number with a fraction or exponent
+   *
+   * \param[out] n The number, rounded to the nearest integer.
+   *
+   * \returns 'true' if the number was parsed successfully.
+   */
+  bool real(long &n) {
+    char buffer[64];
+    std::size_t size = 0;
+
+    while ((p + size < e) && (size < sizeof(buffer) - 1) && (p[size] != 0) &&
+           std::strchr("+-.0123456789eE", p[size]) != nullptr) {
+      buffer[size] = p[size];
+      size++;
+    }
+    buffer[size] = 0;
+
+    char *end;
+    const double d = std::strtod(buffer, &end);
+    if (end == buffer) {
+      return ok = false;
+    }
+
+    n = std::lround(d);
+    p += end - buffer;
+    return true;
+  }
+
+  /**\brief Parse a hex digit */
+  static int hex(char c) {
+    if ((c >= '0') && (c <= '9')) {
+      return c - '0';
+    } else if ((c >= 'a') && (c <= 'f')) {
+      return c - 'a' + 10;
+    } else if ((c >= 'A') && (c <= 'F')) {
+      return c - 'A' + 10;
+    }
+    return -1;
+  }
+
+  bool codepoint(unsigned long &c) {
+    c = 0;
+    if (e - p < 4) {
+      return ok = false;
+    }
+    for (int i = 0; i < 4; i++) {
+      const int d = hex(*p++);
+      if (d < 0) {
+        return ok = false;
+      }
+      c = (c << 4) | d;
+    }
+    return true;
+  }
+
+  /**\brief Parse an escape sequence
+   *
+   * Appends the escaped character to a string; \\u escapes are converted to
+   * UTF-8.
+   *
+   * \param[out] s Where to append the character.
+   *
+   * \returns 'true' if the escape sequence was valid.
+   */
+  bool escape(std::string &s) {
+    unsigned long c;
+
+    p++;
+    if (p >= e) {
+      return ok = false;
+    }
+
+    switch (*p++) {
+    case '"':
+      s.push_back('"');
+      return true;
+    case '\\':
+      s.push_back('\\');
+      return true;
+    case '/':
+      s.push_back('/');
+      return true;
+    case 'b':
+      s.push_back('\b');
+      return true;
+    case 'f':
+      s.push_back('\f');
+      return true;
+    case 'n':
+      s.push_back('\n');
+      return true;
+    case 'r':
+      s.push_back('\r');
+      return true;
+    case 't':
+      s.push_back('\t');
+      return true;
+    case 'u':
+      if (!codepoint(c)) {
+        return false;
+      }
+      if ((c >= 0xd800) && (c < 0xdc00)) {
+        unsigned long low;
+        if (!expect('\\') || !expect('u') || !codepoint(low) ||
+            (low < 0xdc00) || (low >= 0xe000)) {
+          return ok = false;
+        }
+        c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+      }
+      utf8::append(s, c);
+      return true;
+    default:
+      return ok = false;
+    }
+  }
+};
+}
+}
+}
+
+#endif
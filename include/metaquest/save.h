@@ -0,0 +1,355 @@
+/**\file
+ * \brief Saving and loading
+ *
+ * Game objects can write themselves to, and read themselves from, the
+ * serialisers defined here. These work on a stream of values rather than a
+ * full document, so that saves don't need to be built in memory first, and the
+ * same code can deal with different file formats.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_SAVE_H)
+#define METAQUEST_SAVE_H
+
+#include <ef.gy/json.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+namespace metaquest {
+/**\brief Saving and loading
+ *
+ * Contains the interfaces that game objects use to write and read save data,
+ * along with the file formats that implement them.
+ */
+namespace save {
+/**\brief Maximum nesting depth
+ *
+ * Saves don't nest anywhere near this deep; readers fail on values that do,
+ * instead of recursing without bound on corrupt or hostile data.
+ */
+static const std::size_t maxDepth = 64;
+
+/**\brief Save data writer
+ *
+ * Receives save data as a stream of values: objects with keys, arrays, numbers
+ * and strings. Objects and arrays are opened with beginObject() and
+ * beginArray(), and closed with end().
+ */
+class writer {
+public:
+  virtual ~writer(void) {}
+
+  virtual void beginObject(void) = 0;
+  virtual void beginArray(void) = 0;
+  virtual void end(void) = 0;
+
+  /**\brief Write a key
+   *
+   * Starts a new member of the current object; must be followed by exactly
+   * one value.
+   *
+   * \param[in] k The key of the member.
+   */
+  virtual void key(const std::string &k) = 0;
+
+  virtual void number(long n) = 0;
+  virtual void string(std::string_view s) = 0;
+
+  /**\brief Did all writes succeed?
+   *
+   * \returns 'false' if anything went wrong while writing.
+   */
+  virtual bool good(void) const = 0;
+};
+
+/**\brief Save data reader
+ *
+ * The counterpart to save::writer. Objects are read by calling beginObject()
+ * and then key() until it returns false; arrays are read by calling
+ * beginArray() and then next() until it returns false. Members that aren't
+ * needed can be skipped with skip().
+ *
+ * All functions return 'false' when the data doesn't match the request, and a
+ * reader stays in that failed state afterwards.
+ */
+class reader {
+public:
+  /**\brief Value types
+   *
+   * The types of values that can come up next in the data.
+   */
+  enum kind { end, object, array, integer, text };
+
+  virtual ~reader(void) {}
+
+  /**\brief Type of the next value
+   *
+   * \returns What kind of value comes up next; 'end' at the end of an object
+   *          or array, or when the reader has failed.
+   */
+  virtual enum kind peek(void) = 0;
+
+  virtual bool beginObject(void) = 0;
+
+  /**\brief Read a key
+   *
+   * \param[out] k The key of the next member of the current object.
+   *
+   * \returns 'true' if there is another member, 'false' at the end of the
+   *          object.
+   */
+  virtual bool key(std::string &k) = 0;
+
+  virtual bool beginArray(void) = 0;
+
+  /**\brief Is there another element?
+   *
+   * \returns 'true' if there is another element in the current array,
+   *          'false' at the end of the array.
+   */
+  virtual bool next(void) = 0;
+
+  virtual bool number(long &n) = 0;
+  virtual bool string(std::string &s) = 0;
+
+  /**\brief Skip a value
+   *
+   * Skips the next value, including any members or elements it has.
+   *
+   * \returns 'true' if the value was skipped successfully.
+   */
+  virtual bool skip(void) = 0;
+
+  /**\brief Has all data been read successfully?
+   *
+   * \returns 'false' if the reader has failed.
+   */
+  virtual bool good(void) const = 0;
+
+  template <typename T> bool number(T &n) {
+    long l;
+    if (!number(l)) {
+      return false;
+    }
+    n = l;
+    return true;
+  }
+};
+
+/**\brief Save data digest
+ *
+ * A writer that doesn't store anything, but calculates a hash over all the
+ * data that is written to it. Objects that write the same save data have the
+ * same digest, so this can be used to tell if something has changed since it
+ * was last saved.
+ */
+class digest : public writer {
+public:
+  digest(void) : hash(offset) {}
+
+  virtual void beginObject(void) { add("{", 1); }
+  virtual void beginArray(void) { add("[", 1); }
+  virtual void end(void) { add("}", 1); }
+
+  virtual void key(const std::string &k) {
+    add("k", 1);
+    add(k.data(), k.size());
+  }
+
+  virtual void number(long n) {
+    add("i", 1);
+    add(reinterpret_cast<const char *>(&n), sizeof(n));
+  }
+
+  virtual void string(std::string_view s) {
+    const std::size_t size = s.size();
+    add("s", 1);
+    add(reinterpret_cast<const char *>(&size), sizeof(size));
+    add(s.data(), s.size());
+  }
+
+  virtual bool good(void) const { return true; }
+
+  /**\brief Digest of everything written so far. */
+  std::uint64_t value(void) const { return hash; }
+
+protected:
+  static const std::uint64_t offset = 14695981039346656037ull;
+  static const std::uint64_t prime = 1099511628211ull;
+
+  std::uint64_t hash;
+
+  void add(const char *data, std::size_t size) {
+    for (std::size_t i = 0; i < size; i++) {
+      hash = (hash ^ std::uint8_t(data[i])) * prime;
+    }
+  }
+};
+
+/**\brief Buffered file output
+ *
+ * Collects writes in a buffer and passes them on to a file descriptor in
+ * large chunks.
+ */
+class output {
+public:
+  /**\brief Construct with file descriptor
+   *
+   * \param[in] pFD The file descriptor to write to; not closed by this
+   *                class.
+   */
+  output(int pFD) : fd(pFD), ok(pFD >= 0) { buffer.reserve(capacity); }
+
+  ~output(void) { flush(); }
+
+  void write(const char *data, std::size_t size) {
+    if (buffer.size() + size > capacity) {
+      flush();
+    }
+
+    if (size > capacity) {
+      put(data, size);
+    } else {
+      buffer.append(data, size);
+    }
+  }
+
+  void write(std::string_view s) { write(s.data(), s.size()); }
+
+  void write(char c) {
+    if (buffer.size() == capacity) {
+      flush();
+    }
+    buffer.push_back(c);
+  }
+
+  bool flush(void) {
+    put(buffer.data(), buffer.size());
+    buffer.clear();
+    return ok;
+  }
+
+  bool good(void) const { return ok; }
+
+  /**\brief Buffer size, in bytes. */
+  static const std::size_t capacity = 1 << 16;
+
+protected:
+  int fd;
+  bool ok;
+  std::string buffer;
+
+  void put(const char *data, std::size_t size) {
+    while (ok && (size > 0)) {
+      const ssize_t r = ::write(fd, data, size);
+      if (r <= 0) {
+        ok = false;
+      } else {
+        data += r;
+        size -= r;
+      }
+    }
+  }
+};
+
+/**\brief Write a JSON value
+ *
+ * Writes a JSON document as save data. Used for data that is kept as JSON in
+ * memory.
+ *
+ * \param[out] out  The writer to use.
+ * \param[in]  json The value to write.
+ */
+static void write(writer &out, const efgy::json::json &json) {
+  if (json.isObject()) {
+    out.beginObject();
+    for (const auto &m : json.asObject()) {
+      out.key(m.first);
+      write(out, m.second);
+    }
+    out.end();
+  } else if (json.isArray()) {
+    out.beginArray();
+    for (const auto &e : json.asArray()) {
+      write(out, e);
+    }
+    out.end();
+  } else if (json.isString()) {
+    out.string(json.asString());
+  } else {
+    out.number(json.asNumber());
+  }
+}
+
+/**\brief Read a JSON value
+ *
+ * The counterpart to save::write() for JSON values.
+ *
+ * \param[in]  in    The reader to use.
+ * \param[out] json  Where to store the value.
+ * \param[in]  depth How many objects and arrays the value is nested in.
+ *
+ * \returns 'true' if the value was read successfully; fails past maxDepth,
+ *          leaving the reader in the middle of the value.
+ */
+static bool read(reader &in, efgy::json::json &json, std::size_t depth = 0) {
+  if (depth >= maxDepth) {
+    return false;
+  }
+
+  switch (in.peek()) {
+  case reader::object: {
+    std::string k;
+    json.toObject();
+    in.beginObject();
+    while (in.key(k)) {
+      if (!read(in, json(k), depth + 1)) {
+        return false;
+      }
+    }
+    break;
+  }
+  case reader::array:
+    json.toArray();
+    in.beginArray();
+    while (in.next()) {
+      efgy::json::json e;
+      if (!read(in, e, depth + 1)) {
+        return false;
+      }
+      json.push(e);
+    }
+    break;
+  case reader::integer: {
+    long n;
+    in.number(n);
+    json = efgy::json::json::numeric(n);
+    break;
+  }
+  case reader::text: {
+    std::string s;
+    in.string(s);
+    json = s;
+    break;
+  }
+  case reader::end:
+    return false;
+  }
+
+  return in.good();
+}
+}
+}
+
+#endif
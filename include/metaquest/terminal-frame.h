@@ -0,0 +1,282 @@
+/**\file
+ * \brief Frame encoder
+ *
+ * Turns a frame into VT100 output in one buffer, so it can be written with a
+ * single system call. Only cells that changed since the previous frame are
+ * encoded; colours are only set when they change, and the cursor is moved
+ * with the shortest sequence that gets it where it needs to go.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_TERMINAL_FRAME_H)
+#define METAQUEST_TERMINAL_FRAME_H
+
+#include <metaquest/utf8.h>
+
+#include <terminalxx/vt100.h>
+
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace metaquest {
+namespace interact {
+namespace terminal {
+/**\brief Frame encoder
+ *
+ * Keeps the cells as of the last frame, and the terminal's cursor position
+ * and colours as they were left after it.
+ *
+ * \tparam T The cell content type.
+ */
+template <typename T = long> class encoder {
+public:
+  using cell = typename terminalxx::base<T>::cell;
+
+  encoder(void) { reset(); }
+
+  /**\brief Forget the terminal's state
+   *
+   * The next frame is encoded in full, e.g. after something else wrote to
+   * the terminal.
+   */
+  void reset(void) {
+    screen.clear();
+    line = column = unknown;
+    foreground = background = -1;
+  }
+
+  /**\brief Encode a frame
+   *
+   * Post-processes the cells of the lines that may have changed and encodes
+   * those cells that did into the buffer, replacing what was in it. Other
+   * lines are left as they were in the last frame. Every line is looked at
+   * if the size of the screen changed, or after a reset().
+   *
+   * \param[in] terminal    The terminal to encode the target of.
+   * \param[in] postProcess Called for each cell, as with the VT100 backend.
+   * \param[in] dirty       Which lines may have changed; lines past its end
+   *                        are looked at as well.
+   *
+   * \returns The number of cells that changed.
+   */
+  template <typename F>
+  std::size_t frame(const terminalxx::base<T> &terminal, F postProcess,
+                    const std::vector<bool> &dirty) {
+    const auto &target = terminal.target;
+    std::size_t changed = 0;
+    bool full = screen.size() != target.size();
+
+    buffer.clear();
+
+    screen.resize(target.size());
+
+    for (std::size_t l = 0; l < target.size(); l++) {
+      auto &row = screen[l];
+
+      if (row.size() != target[l].size()) {
+        row.resize(target[l].size());
+        full = true;
+      }
+
+      if (!full && (l < dirty.size()) && !dirty[l]) {
+        continue;
+      }
+
+      for (std::size_t c = 0; c < row.size(); c++) {
+        const cell n = postProcess(terminal, l, c);
+
+        if (full || (n != row[c])) {
+          row[c] = n;
+          put(row, l, c);
+          changed++;
+        }
+      }
+    }
+
+    return changed;
+  }
+
+  /**\brief Output for the last frame. */
+  std::string buffer;
+
+  /**\brief Cells as of the last frame. */
+  std::vector<std::vector<cell>> screen;
+
+protected:
+  static constexpr std::size_t unknown = std::size_t(-1);
+
+  /**\brief Cursor position, if known. */
+  std::size_t line, column;
+
+  /**\brief Current colours; -1 if unknown. */
+  long foreground, background;
+
+  /**\brief Encode a cell
+   *
+   * Moves the cursor to the cell, sets its colours and writes its content.
+   * Short gaps on the same line are skipped by writing the cells in between
+   * again, if they're in the current colours, as that's shorter than the
+   * escape sequence to move the cursor.
+   */
+  void put(const std::vector<cell> &row, std::size_t l, std::size_t c) {
+    if ((line == l) && (column != unknown) && (column < c)) {
+      const std::size_t gap = c - column;
+      bool plain = gap < 4;
+
+      for (std::size_t k = column; plain && (k < c); k++) {
+        plain = (row[k].foregroundColour == foreground) &&
+                (row[k].backgroundColour == background) &&
+                (row[k].content < 0x80);
+      }
+
+      if (plain) {
+        for (std::size_t k = column; k < c; k++) {
+          content(row[k].content);
+        }
+      } else {
+        escape(gap, 'C');
+      }
+    } else if ((line != l) || (column != c)) {
+      buffer += "\x1b[";
+      number(l + 1);
+      if (c > 0) {
+        buffer += ';';
+        number(c + 1);
+      }
+      buffer += 'H';
+    }
+
+    colours(row[c]);
+    content(row[c].content);
+
+    line = l;
+    // the cursor's position is unclear after writing to the last column
+    column = c + 1 < row.size() ? c + 1 : unknown;
+  }
+
+  void colours(const cell &n) {
+    const bool fg = n.foregroundColour != foreground;
+    const bool bg = n.backgroundColour != background;
+
+    if (!fg && !bg) {
+      return;
+    }
+
+    buffer += "\x1b[";
+    if (fg) {
+      colour(n.foregroundColour, 30);
+    }
+    if (fg && bg) {
+      buffer += ';';
+    }
+    if (bg) {
+      colour(n.backgroundColour, 40);
+    }
+    buffer += 'm';
+
+    foreground = n.foregroundColour;
+    background = n.backgroundColour;
+  }
+
+  void colour(long c, int base) {
+    if ((c >= 0) && (c < 8)) {
+      number(base + c);
+    } else {
+      number(base + 8);
+      buffer += ";5;";
+      number(c);
+    }
+  }
+
+  void escape(std::size_t n, char command) {
+    buffer += "\x1b[";
+    if (n != 1) {
+      number(n);
+    }
+    buffer += command;
+  }
+
+  void number(unsigned long n) {
+    char digits[24];
+    const auto r = std::to_chars(digits, digits + sizeof(digits), n);
+    buffer.append(digits, r.ptr - digits);
+  }
+
+  void content(T c) { utf8::append(buffer, c == 0 ? ' ' : c); }
+};
+
+/**\brief Console terminal
+ *
+ * The VT100 backend, except that frames are put together by an encoder and
+ * written to the terminal in one go, instead of cell by cell.
+ *
+ * \tparam T The cell content type.
+ */
+template <typename T = long> class console : public terminalxx::vt100<T> {
+public:
+  using base = typename terminalxx::vt100<T>::base;
+  using cell = typename terminalxx::vt100<T>::cell;
+  using command = typename terminalxx::vt100<T>::command;
+
+  console(void) : bytes(0), writes(0) {}
+
+  /**\brief Write a frame
+   *
+   * \param[in] postProcess Called for each cell, as with the VT100 backend.
+   * \param[in] dirty       Which lines may have changed, as for encoder.
+   *
+   * \returns 'false', as the whole frame is always written in one go.
+   */
+  template <typename F>
+  bool flush(F postProcess, const std::vector<bool> &dirty) {
+    encode.frame(*this, postProcess, dirty);
+
+    const std::string &b = encode.buffer;
+    std::size_t done = 0;
+
+    while (done < b.size()) {
+      const ssize_t n =
+          ::write(STDOUT_FILENO, b.data() + done, b.size() - done);
+      if (n > 0) {
+        done += n;
+        writes++;
+      } else if ((n < 0) && (errno == EINTR)) {
+        continue;
+      } else {
+        // the terminal's state is anyone's guess now
+        encode.reset();
+        break;
+      }
+    }
+
+    bytes += done;
+
+    return false;
+  }
+
+  /**\brief Bytes written, over all frames. */
+  std::atomic<std::size_t> bytes;
+
+  /**\brief Write calls, over all frames. */
+  std::atomic<std::size_t> writes;
+
+protected:
+  encoder<T> encode;
+};
+}
+}
+}
+
+#endif
@@ -0,0 +1,224 @@
+/**\file
+ * \brief In-memory terminal
+ *
+ * A terminal backend that doesn't need a TTY: frames are rendered into a cell
+ * buffer in memory, and input comes from a script. Use it in place of the
+ * VT100 backend to run the whole interactive flow headlessly, e.g. to
+ * benchmark or profile it.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_TERMINAL_MEMORY_H)
+#define METAQUEST_TERMINAL_MEMORY_H
+
+#include <metaquest/terminal-frame.h>
+
+#include <terminalxx/vt100.h>
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace metaquest {
+namespace interact {
+namespace terminal {
+/**\brief In-memory terminal
+ *
+ * Has the same interface as the VT100 backend, so it can be used as the term
+ * type of terminal::base. Frames are encoded just like the console backend
+ * would, but kept in memory; if recording is turned on, the output for each
+ * frame is appended to a string. Frames are rendered on the refresher thread,
+ * so the screen and the recorded output are only handed out as copies.
+ *
+ * Input is read from a script of key presses. Once the script runs out, each
+ * read gets a newline, so prompts pick their default and the game moves on.
+ *
+ * \tparam T The cell content type.
+ */
+template <typename T = long> class memory : public terminalxx::base<T> {
+public:
+  using base = terminalxx::base<T>;
+  using cell = typename base::cell;
+  using command = typename terminalxx::vt100<T>::command;
+
+  /**\brief Construct with size
+   *
+   * \param[in] pDimensions Columns and lines of the terminal.
+   */
+  memory(const std::array<std::size_t, 2> &pDimensions = {80, 25})
+      : dimensions(pDimensions), recording(false), frames(0), cells(0),
+        bytes(0), keys(0) {}
+
+  /**\brief Terminal size
+   *
+   * \returns The size the terminal was constructed with.
+   */
+  std::array<std::size_t, 2> getOSDimensions(void) const {
+    return dimensions;
+  }
+
+  /**\brief Render a frame
+   *
+   * Encodes the frame, and records the output if recording is turned on.
+   *
+   * \param[in] postProcess Called for each cell, as with the VT100 backend.
+   * \param[in] dirty       Which lines may have changed, as for encoder.
+   *
+   * \returns 'false', as the whole frame is always rendered in one go.
+   */
+  template <typename F>
+  bool flush(F postProcess, const std::vector<bool> &dirty) {
+    std::lock_guard<std::mutex> lock(frameMutex);
+
+    cells += encode.frame(*this, postProcess, dirty);
+    bytes += encode.buffer.size();
+    frames++;
+
+    if (recording) {
+      output += encode.buffer;
+    }
+
+    return false;
+  }
+
+  /**\brief Read input
+   *
+   * Takes the next key press off the script and passes it to one of the
+   * handlers.
+   *
+   * \param[in] onCommand Called for cursor keys and such.
+   * \param[in] onChar    Called for plain characters.
+   *
+   * \returns Whatever the handler returned.
+   */
+  bool read(std::function<bool(const command &)> onCommand,
+            std::function<bool(const T &)> onChar) {
+    key k{false, '\n'};
+
+    {
+      std::lock_guard<std::mutex> lock(scriptMutex);
+
+      if (!script.empty()) {
+        k = script.front();
+        script.pop_front();
+      }
+    }
+
+    keys++;
+
+    if (k.command) {
+      command c;
+      c.code = k.value;
+      return onCommand(c);
+    }
+
+    return onChar(k.value);
+  }
+
+  /**\brief Script key presses
+   *
+   * \param[in] text Characters to type.
+   */
+  void type(const std::string &text) {
+    std::lock_guard<std::mutex> lock(scriptMutex);
+
+    for (const auto &c : text) {
+      script.push_back({false, T(c)});
+    }
+  }
+
+  /**\brief Script a command key
+   *
+   * \param[in] code The command code, e.g. 'A' for the up cursor key.
+   */
+  void press(const T &code) {
+    std::lock_guard<std::mutex> lock(scriptMutex);
+
+    script.push_back({true, code});
+  }
+
+  /**\brief Read a line of the screen
+   *
+   * \param[in] l The line to read.
+   *
+   * \returns The line's content as of the last frame, as UTF-8.
+   */
+  std::string line(std::size_t l) const {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    std::string rv;
+
+    if (l < encode.screen.size()) {
+      for (const auto &c : encode.screen[l]) {
+        utf8::append(rv, c.content == 0 ? T(' ') : c.content);
+      }
+    }
+
+    return rv;
+  }
+
+  /**\brief Recorded output
+   *
+   * \returns The VT100 output of all frames so far, if recording.
+   */
+  std::string recorded(void) const {
+    std::lock_guard<std::mutex> lock(frameMutex);
+
+    return output;
+  }
+
+  /**\brief Size to report as the OS's terminal size. */
+  std::array<std::size_t, 2> dimensions;
+
+  /**\brief Record VT100 output?
+   *
+   * Set this before the first frame; get the output with recorded().
+   */
+  std::atomic<bool> recording;
+
+  /**\brief Frames rendered. */
+  std::atomic<std::size_t> frames;
+
+  /**\brief Cells that changed, over all frames. */
+  std::atomic<std::size_t> cells;
+
+  /**\brief Bytes of VT100 output, over all frames. */
+  std::atomic<std::size_t> bytes;
+
+  /**\brief Key presses read, including those past the end of the script. */
+  std::atomic<std::size_t> keys;
+
+protected:
+  /**\brief A scripted key press */
+  class key {
+  public:
+    bool command;
+    T value;
+  };
+
+  std::mutex scriptMutex;
+  std::deque<key> script;
+
+  /**\brief Held while a frame is rendered. */
+  mutable std::mutex frameMutex;
+
+  /**\brief VT100 output, if recording. */
+  std::string output;
+
+  encoder<T> encode;
+};
+}
+}
+}
+
+#endif
@@ -19,18 +19,30 @@
 
 #include <terminalxx/vt100.h>
 #include <terminalxx/terminal-writer.h>
+#include <metaquest/terminal-frame.h>
 #include <metaquest/game.h>
 #include <metaquest/ai.h>
+#include <metaquest/logbook.h>
+#include <metaquest/ring.h>
 #include <optional>
 #include <random>
-#include <sstream>
+#include <array>
 #include <chrono>
 #include <list>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
 #include <utility>
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+#include <cstdint>
 
 namespace metaquest {
 namespace interact {
@@ -53,26 +65,32 @@ public:
     return true;
   }
 
-  bool valid(void) {
-    return validUntil ? clock::now() < *validUntil : true;
+  bool valid(void) { return valid(clock::now()); }
+
+  bool valid(const typename clock::time_point &now) const {
+    return validUntil ? now < *validUntil : true;
   }
 
+  /**\brief How far along the animator is
+   *
+   * \param[in] until How long the animator plays for.
+   *
+   * \returns The fraction of that time that has passed, up to 1; animators
+   *          that don't play for any time at all are done right away.
+   */
   double progress(typename clock::duration until) {
-    const auto el = std::chrono::duration_cast<std::chrono::milliseconds>(
-                        clock::now() - validSince).count();
-    const auto ts =
-        std::chrono::duration_cast<std::chrono::milliseconds>(until).count();
+    const auto el = (clock::now() - validSince).count();
+    const auto ts = until.count();
+
+    if (ts <= 0) {
+      return 1.0;
+    }
 
     return std::min((double)el / (double)ts, 1.0);
   }
 
   double progress(typename clock::time_point until) {
-    const auto el = std::chrono::duration_cast<std::chrono::milliseconds>(
-                        clock::now() - validSince).count();
-    const auto ts = std::chrono::duration_cast<std::chrono::milliseconds>(
-                        until - validSince).count();
-
-    return std::min((double)el / (double)ts, 1.0);
+    return progress(until - validSince);
   }
 
   double progress(void) {
@@ -83,13 +101,93 @@ public:
     return progress(*validUntil);
   }
 
+  /**\brief When the animator expires
+   *
+   * \returns The time the animator stops being valid, if it has a limit.
+   */
+  std::optional<typename clock::time_point> expiry(void) const {
+    return validUntil;
+  }
+
+  /**\brief When the animator starts
+   *
+   * Animators don't affect the screen before this time.
+   *
+   * \returns The time the animator starts.
+   */
+  typename clock::time_point start(void) const { return validSince; }
+
+  bool started(const typename clock::time_point &now) const {
+    return !(now < validSince);
+  }
+
+  /**\brief Schedule the animator
+   *
+   * Moves the animator's start, and its expiry along with it. Call this
+   * before adding the animator. However fast it's played, an animator that
+   * expires plays for at least one clock tick.
+   *
+   * \param[in] pStart When the animator should start.
+   * \param[in] speed  How much faster than normal to play the animator.
+   */
+  void play(const typename clock::time_point &pStart, double speed = 1) {
+    if (validUntil) {
+      const auto length = std::chrono::duration_cast<typename clock::duration>(
+          (*validUntil - validSince) / speed);
+      validUntil = pStart + std::max(length, typename clock::duration(1));
+    }
+    validSince = pStart;
+  }
+
   virtual bool draw(typename term::base &terminal) = 0;
   virtual bool postProcess(const typename term::base &terminal,
                            const std::size_t &l, const std::size_t &c,
                            typename term::cell &cell) = 0;
 
+  /**\brief Screen region
+   *
+   * A rectangle of cells on the screen.
+   */
+  class region {
+  public:
+    std::size_t column;
+    std::size_t line;
+    std::size_t width;
+    std::size_t height;
+
+    bool operator==(const region &b) const {
+      return (column == b.column) && (line == b.line) && (width == b.width) &&
+             (height == b.height);
+    }
+
+    bool operator!=(const region &b) const { return !(*this == b); }
+  };
+
+  /**\brief Affected region
+   *
+   * postProcess() must not change any cells outside of this region.
+   *
+   * \returns The region of the screen that the animator affects.
+   */
+  virtual region area(void) const = 0;
+
+  /**\brief Does the animator change over time?
+   *
+   * Animators that don't are only redrawn when they are added, moved or
+   * removed.
+   *
+   * \returns 'true' if postProcess() depends on the time.
+   */
+  virtual bool animated(void) const { return false; }
+
   const typename clock::duration sleepTime;
 
+  /**\brief Region as of the last frame
+   *
+   * Maintained by the refresher, to find out which lines need to be redrawn.
+   */
+  std::optional<region> painted;
+
 protected:
   typename clock::time_point validSince;
   std::optional<typename clock::time_point> validUntil;
@@ -117,6 +215,10 @@ public:
     return false;
   }
 
+  virtual typename base<term, clock>::region area(void) const {
+    return {column, line, width, height};
+  }
+
   std::size_t column;
   std::size_t line;
   std::size_t width;
@@ -152,6 +254,8 @@ public:
 
   virtual bool draw(typename term::base &) { return false; }
 
+  virtual bool animated(void) const { return true; }
+
   virtual bool postProcess(const typename term::base &terminal,
                            const std::size_t &l, const std::size_t &c,
                            typename term::cell &cell) {
@@ -165,6 +269,10 @@ public:
     return false;
   }
 
+  virtual typename base<term, clock>::region area(void) const {
+    return {column, line, width, height};
+  }
+
   std::size_t column;
   std::size_t line;
   std::size_t width;
@@ -184,6 +292,8 @@ public:
 
   virtual bool draw(typename term::base &) { return false; }
 
+  virtual bool animated(void) const { return true; }
+
   virtual bool postProcess(const typename term::base &terminal,
                            const std::size_t &l, const std::size_t &c,
                            typename term::cell &cell) {
@@ -198,6 +308,10 @@ public:
     return false;
   }
 
+  virtual typename base<term, clock>::region area(void) const {
+    return {column, line, width, height};
+  }
+
   std::size_t column;
   std::size_t line;
   std::size_t width;
@@ -231,12 +345,508 @@ public:
     return false;
   }
 
+  virtual typename base<term, clock>::region area(void) const {
+    return {0, line, std::numeric_limits<std::size_t>::max(), 1};
+  }
+
   std::size_t line;
   std::string message;
 };
+
+/**\brief Animator handle
+ *
+ * Refers to an animator in a pool. Handles stay safe to use after the
+ * animator is gone; they just don't refer to anything anymore.
+ */
+class handle {
+public:
+  std::uint32_t type;
+  std::uint32_t index;
+  std::uint32_t generation;
+};
+
+/**\brief Handle reservations
+ *
+ * Hands out handles for new animators on the game's thread, so the game
+ * doesn't need to wait for the refresher thread to add them to the pool. A
+ * slot is only handed out again after the pool has released it.
+ *
+ * \tparam n The number of animator types.
+ */
+template <std::size_t n> class reservations {
+public:
+  /**\brief Reserve a handle
+   *
+   * \param[in] type The index of the animator's type in the pool.
+   *
+   * \returns A handle for a slot that the pool isn't using.
+   */
+  handle reserve(std::uint32_t type) {
+    auto &gs = generations[type];
+
+    if (free[type].empty()) {
+      gs.push_back(0);
+      return {type, std::uint32_t(gs.size() - 1), 0};
+    }
+
+    const std::uint32_t i = free[type].back();
+    free[type].pop_back();
+    return {type, i, gs[i]};
+  }
+
+  /**\brief Release a handle
+   *
+   * \param[in] h A handle whose animator the pool has removed.
+   */
+  void release(const handle &h) {
+    generations[h.type][h.index] = h.generation + 1;
+    free[h.type].push_back(h.index);
+  }
+
+protected:
+  std::array<std::vector<std::uint32_t>, n> free;
+
+  /**\brief Generation that each slot is at. */
+  std::array<std::vector<std::uint32_t>, n> generations;
+};
+
+/**\brief Animator pool
+ *
+ * Keeps animators in one vector per type, reuses the slots of expired
+ * animators and removes animators in the order of their deadlines, so that
+ * expiring any number of animators only costs time for those that expire.
+ * Post-processing is done type by type, without virtual calls.
+ *
+ * The pool belongs to the refresher thread; the game changes it by sending
+ * commands.
+ *
+ * \tparam types The animator types that the pool can hold.
+ */
+template <typename term, typename clock, typename... types> class pool {
+public:
+  using animator = base<term, clock>;
+  using reservations = terminal::animator::reservations<sizeof...(types)>;
+
+  /**\brief Change to the pool
+   *
+   * Adds an animator to the slot of a reserved handle, changes or expires an
+   * animator.
+   */
+  class command {
+  public:
+    enum kind { add, update, expire };
+
+    enum kind what;
+    handle target;
+    std::optional<std::variant<types...>> value;
+    std::function<void(animator &)> change;
+  };
+
+  pool(void) : count(0) {}
+
+  /**\brief Index of an animator type
+   *
+   * \returns The index of the type, as used in handles.
+   */
+  template <typename A, std::uint32_t i = 0>
+  static constexpr std::uint32_t index(void) {
+    static_assert(i < sizeof...(types), "animator type not in pool");
+    if constexpr (std::is_same_v<A, std::tuple_element_t<
+                                        i, std::tuple<types...>>>) {
+      return i;
+    } else {
+      return index<A, i + 1>();
+    }
+  }
+
+  /**\brief Add an animator
+   *
+   * \param[in] h The reserved handle for the animator.
+   * \param[in] a The new animator.
+   */
+  template <typename A> void add(const handle &h, A &&a) {
+    auto &slots = std::get<index<std::decay_t<A>>()>(store);
+
+    if (h.index >= slots.size()) {
+      slots.resize(h.index + 1);
+    }
+
+    slots[h.index].value.emplace(std::forward<A>(a));
+    slots[h.index].generation = h.generation;
+    count++;
+
+    schedule(h, *slots[h.index].value);
+  }
+
+  /**\brief Apply a command
+   *
+   * \param[in] c The command to apply.
+   *
+   * \returns 'true' if the command changed anything.
+   */
+  bool apply(command &c) {
+    switch (c.what) {
+    case command::add:
+      std::visit([this, &c](auto &a) { add(c.target, std::move(a)); },
+                 *c.value);
+      return true;
+    case command::update:
+      if (animator *a = get(c.target)) {
+        const auto e = a->expiry();
+        c.change(*a);
+        if (a->expiry() != e) {
+          // the old deadline is skipped when it comes up
+          schedule(c.target, *a);
+        }
+        return true;
+      }
+      return false;
+    case command::expire:
+      return expire(c.target);
+    }
+
+    return false;
+  }
+
+  /**\brief Look up an animator
+   *
+   * \param[in] h The animator's handle.
+   *
+   * \returns The animator, or a null pointer if it is gone or doesn't have
+   *          the given type.
+   */
+  template <typename A> A *get(const handle &h) {
+    constexpr std::uint32_t t = index<A>();
+    if (h.type != t) {
+      return nullptr;
+    }
+    return find(std::get<t>(store), h);
+  }
+
+  animator *get(const handle &h) {
+    animator *rv = nullptr;
+    visit(h.type, [&rv, &h](auto &slots) { rv = find(slots, h); });
+    return rv;
+  }
+
+  /**\brief Expire an animator
+   *
+   * \param[in] h The animator's handle.
+   *
+   * \returns 'true' if there was an animator to expire.
+   */
+  bool expire(const handle &h) {
+    animator *a = get(h);
+    if (a == nullptr) {
+      return false;
+    }
+    a->expire();
+    schedule(h, *a);
+    return true;
+  }
+
+  /**\brief Remove expired animators
+   *
+   * \param[in] now    The current time.
+   * \param[in] remove Called with each animator and its handle before it is
+   *                   removed; the handle's slot is free after that.
+   */
+  template <typename F>
+  void sweep(const typename clock::time_point &now, F remove) {
+    while (!deadlines.empty() && !(now < deadlines.top().first)) {
+      const handle h = deadlines.top().second;
+      deadlines.pop();
+
+      animator *a = get(h);
+      if ((a != nullptr) && !a->valid(now)) {
+        remove(*a, h);
+        visit(h.type, [&h](auto &slots) {
+          slots[h.index].value.reset();
+          slots[h.index].generation++;
+        });
+        count--;
+      }
+    }
+  }
+
+  /**\brief Call a function for each animator
+   *
+   * \param[in] f Called with each animator, as its actual type.
+   */
+  template <typename F> void each(F f) {
+    std::apply(
+        [&f](auto &... slots) {
+          (
+              [&f](auto &ss) {
+                for (auto &s : ss) {
+                  if (s.value) {
+                    f(*s.value);
+                  }
+                }
+              }(slots),
+              ...);
+        },
+        store);
+  }
+
+  /**\brief Earliest deadline
+   *
+   * \returns When the next animator might expire, if any will.
+   */
+  std::optional<typename clock::time_point> next(void) const {
+    if (deadlines.empty()) {
+      return std::optional<typename clock::time_point>();
+    }
+    return deadlines.top().first;
+  }
+
+  std::size_t size(void) const { return count; }
+
+  /**\brief Sort animators by line
+   *
+   * Records which animators affect which lines, for postProcess().
+   *
+   * \param[in] height The number of lines on the screen.
+   * \param[in] now    The time of the frame; animators that haven't started
+   *                   yet or have expired are left out.
+   */
+  void layout(std::size_t height, const typename clock::time_point &now) {
+    std::apply(
+        [height](auto &... ls) { ((ls.assign(height, {})), ...); }, lines);
+
+    each([this, height, &now](auto &a) {
+      using A = std::decay_t<decltype(a)>;
+      if (!a.started(now) || !a.valid(now)) {
+        return;
+      }
+
+      auto &ls = std::get<index<A>()>(lines);
+      const auto area = a.area();
+
+      for (std::size_t l = area.line;
+           (l < height) && (l - area.line < area.height); l++) {
+        ls[l].push_back(&a);
+      }
+    });
+  }
+
+  /**\brief Apply animators to a cell
+   *
+   * Applies the animators that affect the cell's line, as recorded by the
+   * last call to layout(); these were valid as of the frame's time.
+   */
+  void postProcess(const typename term::base &terminal, const std::size_t &l,
+                   const std::size_t &c, typename term::cell &cell) {
+    std::apply(
+        [&](auto &... ls) {
+          ((l < ls.size() ? process(ls[l], terminal, l, c, cell) : void()),
+           ...);
+        },
+        lines);
+  }
+
+protected:
+  template <typename A> class slot {
+  public:
+    std::optional<A> value;
+    std::uint32_t generation = 0;
+  };
+
+  std::tuple<std::vector<slot<types>>...> store;
+  std::size_t count;
+
+  /**\brief Animators on each line, by type. */
+  std::tuple<std::vector<std::vector<types *>>...> lines;
+
+  using deadline = std::pair<typename clock::time_point, handle>;
+
+  class later {
+  public:
+    bool operator()(const deadline &a, const deadline &b) const {
+      return b.first < a.first;
+    }
+  };
+
+  std::priority_queue<deadline, std::vector<deadline>, later> deadlines;
+
+  template <typename F> void visit(std::uint32_t type, F f) {
+    std::uint32_t i = 0;
+    std::apply(
+        [&](auto &... slots) { ((i++ == type ? f(slots) : void()), ...); },
+        store);
+  }
+
+  template <typename A>
+  static A *find(std::vector<slot<A>> &slots, const handle &h) {
+    if ((h.index < slots.size()) &&
+        (slots[h.index].generation == h.generation) && slots[h.index].value) {
+      return &*slots[h.index].value;
+    }
+    return nullptr;
+  }
+
+  void schedule(const handle &h, const animator &a) {
+    const auto e = a.expiry();
+    if (e) {
+      deadlines.push({*e, h});
+    }
+  }
+
+  template <typename A>
+  static void process(const std::vector<A *> &as,
+                      const typename term::base &terminal,
+                      const std::size_t &l, const std::size_t &c,
+                      typename term::cell &cell) {
+    for (auto *a : as) {
+      (void)a->A::postProcess(terminal, l, c, cell);
+    }
+  }
+};
 }
 
-template <typename term = terminalxx::vt100<>,
+/**\brief Atomically swapped shared pointer
+ *
+ * The one place that uses std::atomic_load() and std::atomic_store() on a
+ * std::shared_ptr. Those are deprecated in C++20: once the tree moves on to
+ * that, this is the one thing to change, to a std::atomic<std::shared_ptr>.
+ *
+ * \tparam T The type pointed to.
+ */
+template <typename T> class shared {
+public:
+  std::shared_ptr<T> load(void) const { return std::atomic_load(&pointer); }
+
+  void store(std::shared_ptr<T> p) { std::atomic_store(&pointer, p); }
+
+protected:
+  std::shared_ptr<T> pointer;
+};
+
+/**\brief Rendering statistics
+ *
+ * Collected by the refresher thread and read by the game's thread, e.g. for
+ * the debug overlay or the JSON dump; all counters are atomic, so reading
+ * them never holds up a frame.
+ */
+class statistics {
+public:
+  /**\brief Histogram
+   *
+   * Counts values in power-of-two buckets: bucket 0 has the zeroes, and
+   * bucket i > 0 the values from 2^(i-1) up to, but not including, 2^i.
+   */
+  class histogram {
+  public:
+    static const std::size_t size = 32;
+
+    histogram(void) : count(0), total(0), maximum(0) {
+      for (auto &b : buckets) {
+        b = 0;
+      }
+    }
+
+    void add(std::uint64_t v) {
+      std::size_t i = 0;
+      while ((i < size - 1) && (v >> i) != 0) {
+        i++;
+      }
+
+      buckets[i].fetch_add(1, std::memory_order_relaxed);
+      count.fetch_add(1, std::memory_order_relaxed);
+      total.fetch_add(v, std::memory_order_relaxed);
+
+      std::uint64_t m = maximum.load(std::memory_order_relaxed);
+      while ((v > m) && !maximum.compare_exchange_weak(m, v)) {
+      }
+    }
+
+    /**\brief Approximate percentile
+     *
+     * \param[in] p The percentile, between 0 and 1.
+     *
+     * \returns The upper bound of the bucket the percentile falls into.
+     */
+    std::uint64_t percentile(double p) const {
+      const std::uint64_t n = count.load(std::memory_order_relaxed);
+      const std::uint64_t rank = std::uint64_t(p * n);
+      std::uint64_t seen = 0;
+
+      for (std::size_t i = 0; i < size; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if ((seen > rank) || (i == size - 1)) {
+          return i == 0 ? 0 : (std::uint64_t(1) << i) - 1;
+        }
+      }
+
+      return 0;
+    }
+
+    std::uint64_t mean(void) const {
+      const std::uint64_t n = count.load(std::memory_order_relaxed);
+      return n == 0 ? 0 : total.load(std::memory_order_relaxed) / n;
+    }
+
+    efgy::json::json json(void) const {
+      efgy::json::json rv;
+
+      rv("count") = efgy::json::json::numeric(count.load());
+      rv("mean") = efgy::json::json::numeric(mean());
+      rv("max") = efgy::json::json::numeric(maximum.load());
+      rv("p50") = efgy::json::json::numeric(percentile(0.5));
+      rv("p99") = efgy::json::json::numeric(percentile(0.99));
+
+      auto &bs = rv("buckets").toArray();
+      for (const auto &b : buckets) {
+        bs.push(efgy::json::json::numeric(b.load()));
+      }
+
+      return rv;
+    }
+
+    std::array<std::atomic<std::uint64_t>, size> buckets;
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> total;
+    std::atomic<std::uint64_t> maximum;
+  };
+
+  /**\brief Time to work out and write a frame, in microseconds. */
+  histogram frame;
+
+  /**\brief Time from reading a key press to the next frame, in
+   * microseconds. */
+  histogram latency;
+
+  /**\brief Cells post-processed per frame. */
+  histogram cells;
+
+  /**\brief Bytes written per frame, if the terminal keeps count. */
+  histogram bytes;
+
+  efgy::json::json json(void) const {
+    efgy::json::json rv;
+
+    rv("frame") = frame.json();
+    rv("latency") = latency.json();
+    rv("cells") = cells.json();
+    rv("bytes") = bytes.json();
+
+    return rv;
+  }
+
+  /**\brief One-line summary
+   *
+   * \returns Frame time and input latency, as shown by the debug overlay.
+   */
+  std::string summary(void) const {
+    return " frame " + std::to_string(frame.percentile(0.5)) + "/" +
+           std::to_string(frame.percentile(0.99)) + "us input " +
+           std::to_string(latency.percentile(0.5)) + "/" +
+           std::to_string(latency.percentile(0.99)) + "us cells " +
+           std::to_string(cells.mean()) + " ";
+  }
+};
+
+template <typename term = console<>,
           template <typename> class AI = ai::random,
           typename clock = std::chrono::system_clock>
 class base;
@@ -244,87 +854,398 @@ class base;
 template <typename term, template <typename> class AI, typename clock>
 class refresher {
 public:
-  refresher(base<term, AI> &pBase) : base(pBase) {}
+  using animators = typename base<term, AI, clock>::animators;
+  using animator = animator::base<term, clock>;
+  using handle = terminal::animator::handle;
+  using scene = typename base<term, AI, clock>::scene;
+  using row = typename base<term, AI, clock>::row;
+
+  refresher(base<term, AI> &pBase) : base(pBase), out(pBase.io), cleared(0) {}
+
+  /**\brief Apply the game's commands
+   *
+   * Takes everything the game has sent since the last frame off the command
+   * queue.
+   */
+  void receive(void) {
+    while (auto c = base.commands.pop()) {
+      active.apply(*c);
+    }
+  }
 
+  /**\brief Update animators
+   *
+   * Removes expired animators, hands their slots back to the game and works
+   * out which lines they changed.
+   *
+   * \returns 'true' if any animator drew anything.
+   */
   bool refresh() {
-    std::lock_guard<std::mutex> lock(base.activeMutex);
-
-    for (auto it = base.active.begin(); it != base.active.end();) {
-      if (!(*it)->valid()) {
-        auto *p = *it;
-        base.active.erase(it);
-        delete p;
-        it = base.active.begin();
-      } else {
-        it++;
-      }
+    const auto now = clock::now();
+
+    dirty.assign(base.io.size()[1], false);
+
+    for (std::size_t l = 0; (l < base.written.size()) && (l < dirty.size());
+         l++) {
+      dirty[l] = base.written[l];
+    }
+    base.written.assign(base.written.size(), false);
+
+    present();
+
+    active.sweep(now, [this](animator &a, const handle &h) {
+      mark(a.painted);
+      released.push_back(h);
+    });
+
+    while (!released.empty() &&
+           base.released.push(std::move(released.back()))) {
+      released.pop_back();
     }
 
     bool ret = false;
 
-    for (const auto &a : base.active) {
-      if (a->valid()) {
-        ret = a->draw(base.io) || ret;
+    active.each([this, &ret, &now](auto &a) {
+      if (!a.started(now)) {
+        return;
       }
-    }
+
+      ret = a.draw(base.io) || ret;
+
+      const auto area = a.area();
+      if (a.animated() || !a.painted || (*a.painted != area)) {
+        mark(a.painted);
+        mark(area);
+        a.painted = area;
+      }
+    });
+
+    active.layout(dirty.size(), now);
 
     return ret;
   }
 
+  /**\brief Draw the party rows
+   *
+   * Picks up the latest scene the game published, and redraws the rows that
+   * changed since the last one; if the game cleared the query area since,
+   * the rows in it are redrawn as well.
+   */
+  void present(void) {
+    const auto s = base.published.load();
+    const std::size_t c = base.cleared;
+
+    if (!s || (current && (current->version == s->version) && (c == cleared))) {
+      return;
+    }
+
+    if (!current || (current->epoch != s->epoch)) {
+      // the game cleared the screen, so none of the rows are there anymore
+      rows.clear();
+    }
+
+    if (c != cleared) {
+      for (auto &r : rows) {
+        const std::size_t l = line(r);
+        if ((l >= base.queryLine) && (l < base.queryLine + base.queryLines)) {
+          r.shown = false;
+        }
+      }
+      cleared = c;
+    }
+
+    std::size_t r = 0;
+
+    for (const auto &now : s->rows) {
+      if ((r < rows.size()) && (rows[r].line != now.line)) {
+        // the layout changed, so everything from here on moved
+        forget(r);
+      }
+
+      if (r == rows.size()) {
+        rows.push_back(now);
+        draw(now);
+      } else if (rows[r] != now) {
+        rows[r] = now;
+        draw(now);
+      }
+
+      r++;
+    }
+
+    forget(r);
+
+    current = s;
+  }
+
   typename term::cell postProcess(const typename term::base &terminal,
                                   const std::size_t &l, const std::size_t &c) {
     typename term::cell cell = terminal.target[l][c];
 
-    for (const auto &a : base.active) {
-      if (a->valid()) {
-        (void)a->postProcess(terminal, l, c, cell);
-      }
+    active.postProcess(terminal, l, c, cell);
+
+    if ((l == 0) && (overlay.size() > 0) && (c + overlay.size() >= width) &&
+        (c < width)) {
+      cell.content = overlay[c + overlay.size() - width];
+      cell.foregroundColour = 0;
+      cell.backgroundColour = 7;
     }
 
+    cells++;
+
     return cell;
   }
 
-  void flush(void) {
-    std::lock_guard<std::mutex> lock(base.activeMutex);
+  /**\brief Update the screen
+   *
+   * Writes out the lines that animators or the game changed since the last
+   * frame; only those are post-processed and compared with what's on the
+   * screen. Nothing is written if there are none.
+   *
+   * \returns 'true' if a frame was written.
+   */
+  bool flush(void) {
+    base.damaged = false;
+    if (std::find(dirty.begin(), dirty.end(), true) == dirty.end()) {
+      return false;
+    }
+
+    cells = 0;
+    width = base.io.size()[0];
+    overlay.clear();
+    if (base.overlay) {
+      overlay = base.stats.summary();
+    }
 
-    while (base.io.flush([this](const typename term::base &terminal,
-                                const std::size_t &l,
-                                const std::size_t &c) -> typename term::cell {
-      return postProcess(terminal, l, c);
-    }))
+    if ((overlaid || !overlay.empty()) && !dirty.empty()) {
+      dirty[0] = true;
+    }
+    overlaid = !overlay.empty();
+
+    while (base.io.flush(
+        [this](const typename term::base &terminal, const std::size_t &l,
+               const std::size_t &c) -> typename term::cell {
+          return postProcess(terminal, l, c);
+        },
+        dirty))
       ;
+
+    dirty.assign(dirty.size(), false);
+
+    return true;
   }
 
-  typename clock::duration sleepTime(void) {
-    std::lock_guard<std::mutex> lock(base.activeMutex);
+  /**\brief Draw a frame and time it
+   *
+   * Records how long the frame took, how many cells it post-processed and
+   * how long the last key press waited for it.
+   */
+  void frame(void) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // taken before the frame, so the frame is sure to show the key press
+    auto pressed = base.pressed.exchange(0);
+
+    receive();
 
-    typename clock::duration sleepFor = std::chrono::milliseconds(50);
+    std::size_t before;
+    bool flushed;
+
+    {
+      std::lock_guard<std::mutex> lock(base.screenMutex);
+
+      refresh();
+      before = written();
+      flushed = flush();
+    }
 
-    for (const auto &a : base.active) {
-      if (a->valid()) {
-        if (a->sleepTime < sleepFor) {
-          sleepFor = a->sleepTime;
+    if (!flushed) {
+      // hand it on to the frame that shows it, unless there's a newer one
+      std::chrono::steady_clock::rep none = 0;
+      base.pressed.compare_exchange_strong(none, pressed);
+      return;
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    base.stats.frame.add(microseconds(end - start));
+    base.stats.cells.add(cells);
+    base.stats.bytes.add(written() - before);
+
+    if (pressed != 0) {
+      base.stats.latency.add(microseconds(
+          end - std::chrono::steady_clock::time_point(
+                    std::chrono::steady_clock::duration(pressed))));
+    }
+  }
+
+  /**\brief Next deadline
+   *
+   * Works out when the next frame is needed even if nothing else happens:
+   * animated animators need a new frame after their sleep time, and the
+   * others when they start or expire.
+   *
+   * \returns The time of the next frame, if any.
+   */
+  std::optional<typename clock::time_point> deadline(void) {
+    std::optional<typename clock::time_point> next = active.next();
+    const auto now = clock::now();
+
+    active.each([&next, &now](const auto &a) {
+      if (!a.started(now)) {
+        if (!next || (a.start() < *next)) {
+          next = a.start();
         }
+      } else if (a.animated() && (!next || (now + a.sleepTime < *next))) {
+        next = now + a.sleepTime;
       }
-    }
+    });
 
-    return sleepFor;
+    return next;
   }
 
+  /**\brief Refresher thread
+   *
+   * Draws a frame, then sleeps until the next deadline or until the game
+   * wakes it up, whichever comes first; if nothing on screen is animated,
+   * it sleeps until woken up. The wake mutex is only held while sleeping;
+   * the game only waits for a frame if it writes to the screen while the
+   * frame is drawn.
+   *
+   * \param[in] pBase The terminal to refresh.
+   */
   static void run(base<term, AI, clock> &pBase) {
     refresher self(pBase);
+    std::unique_lock<std::mutex> lock(pBase.wakeMutex);
+    const auto woken = [&pBase] {
+      return !pBase.alive || pBase.damaged || pBase.changed;
+    };
+
+    while (pBase.alive) {
+      pBase.changed = false;
+      lock.unlock();
+
+      self.frame();
 
-    while (self.base.alive) {
-      self.refresh();
-      self.flush();
-      std::this_thread::sleep_for(self.sleepTime());
+      const auto next = self.deadline();
+
+      lock.lock();
+      if (next) {
+        pBase.wake.wait_until(lock, *next, woken);
+      } else {
+        pBase.wake.wait(lock, woken);
+      }
     }
 
-    self.flush();
+    lock.unlock();
+
+    self.frame();
   }
 
 protected:
   base<term, AI, clock> &base;
+
+  /**\brief The animators; only this thread ever touches them. */
+  animators active;
+
+  /**\brief Removed animators that the game hasn't been told about yet. */
+  std::vector<handle> released;
+
+  /**\brief Cells post-processed in the current frame. */
+  std::size_t cells = 0;
+
+  /**\brief Debug overlay text for the current frame, if any. */
+  std::string overlay;
+
+  /**\brief Was the overlay shown in the last frame? */
+  bool overlaid = false;
+
+  /**\brief Width of the screen in the current frame. */
+  std::size_t width = 0;
+
+  /**\brief Draws the party rows. */
+  terminalxx::writer<> out;
+
+  /**\brief The scene the party rows were last drawn from. */
+  std::shared_ptr<const scene> current;
+
+  /**\brief Party member rows, as last drawn. */
+  std::vector<row> rows;
+
+  /**\brief How often the query area had been cleared as of the last frame. */
+  std::size_t cleared;
+
+  /**\brief Screen line of a row */
+  std::size_t line(const row &r) const {
+    return r.line < 0 ? long(dirty.size()) + r.line : r.line;
+  }
+
+  void draw(const row &r) {
+    out.to(0, r.line)
+        .clear(-1, 1)
+        .to(2, r.line)
+        .write(r.name, 28)
+        .x(-60)
+        .write(std::to_string(r.stats[0]), 4, 1)
+        .x(-55)
+        .write(std::to_string(r.stats[2]), 4, 4)
+        .x(-50)
+        .bar2c(r.stats[0], r.stats[1], r.stats[2], r.stats[3], 50, 1, 4);
+
+    if (line(r) < dirty.size()) {
+      dirty[line(r)] = true;
+    }
+  }
+
+  /**\brief Remove rows
+   *
+   * Clears the lines of all rows from the given one on, and drops them.
+   *
+   * \param[in] from The first row to remove.
+   */
+  void forget(std::size_t from) {
+    for (std::size_t r = from; r < rows.size(); r++) {
+      out.to(0, rows[r].line).clear(-1, 1);
+
+      if (line(rows[r]) < dirty.size()) {
+        dirty[line(rows[r])] = true;
+      }
+    }
+    rows.resize(from);
+  }
+
+  static std::uint64_t microseconds(const std::chrono::nanoseconds &d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  }
+
+  /**\brief Bytes the terminal has written so far, if it keeps count. */
+  std::size_t written(void) const {
+    if constexpr (counts<term>::value) {
+      return base.io.bytes;
+    } else {
+      return 0;
+    }
+  }
+
+  template <typename T, typename = void>
+  class counts : public std::false_type {};
+
+  template <typename T>
+  class counts<T, std::void_t<decltype(std::declval<T &>().bytes)>>
+      : public std::true_type {};
+
+  /**\brief Lines that animators changed since the last frame. */
+  std::vector<bool> dirty;
+
+  void mark(const std::optional<typename animator::region> &area) {
+    if (!area) {
+      return;
+    }
+
+    for (std::size_t l = area->line;
+         (l < dirty.size()) && (l - area->line < area->height); l++) {
+      dirty[l] = true;
+    }
+  }
 };
 
 template <typename term, template <typename> class AI, typename clock>
@@ -335,58 +1256,364 @@ public:
   using glow = animator::glow<term, clock>;
   using text = animator::text<term, clock>;
   using flash = animator::flash<term, clock>;
+  using animators =
+      animator::pool<term, clock, selector, highlight, glow, text, flash>;
+
+  /**\brief The query area
+   *
+   * First line and number of lines of the area between the parties, where
+   * menus and dialogues are shown; clearQuery() clears it.
+   */
+  static constexpr std::size_t queryLine = 8;
+  static constexpr std::size_t queryLines = 10;
 
   base()
-      : io(), out(io), ai(*this), alive(true),
-        refresherThread(refresher<term, AI, clock>::run, std::ref(*this)) {
-    logbook.toArray();
+      : io(), out(io), ai(*this), speed(1), timeline(clock::now()),
+        overlay(false), pressed(0), typed(0), epoch(0), cleared(0),
+        damaged(true), alive(true), changed(false) {
     io.resize(io.getOSDimensions());
     clear();
+
+    // only start refreshing once the screen is set up
+    refresherThread =
+        std::thread(refresher<term, AI, clock>::run, std::ref(*this));
   }
 
   ~base(void) {
+    logbook.flush();
     clear();
-    alive = false;
-    refresherThread.join();
-    for (auto &a : active) {
-      delete a;
+    {
+      std::lock_guard<std::mutex> lock(wakeMutex);
+
+      alive = false;
     }
+    wake.notify_one();
+    refresherThread.join();
   }
 
   term io;
   terminalxx::writer<> out;
   AI<base<term, AI>> ai;
-  efgy::json::json logbook;
+  metaquest::logbook logbook;
+
+  /**\brief Animation speed
+   *
+   * 1 plays animations at their normal speed, 2 twice as fast and so on; 0
+   * skips them altogether.
+   */
+  double speed;
+
+  /**\brief End of the animation timeline
+   *
+   * Actions are animated one after the other, without the game waiting for
+   * them; this is when the last one that was scheduled will be done.
+   */
+  typename clock::time_point timeline;
+
+  /**\brief A party member's row on the screen */
+  class row {
+  public:
+    /**\brief Line of the row; negative lines count from the bottom. */
+    long line;
+
+    /**\brief Is the row still on the screen? */
+    bool shown;
+
+    std::string name;
+
+    /**\brief Current and total HP, then current and total MP. */
+    std::array<long, 4> stats;
+
+    bool operator==(const row &b) const {
+      return (line == b.line) && (shown == b.shown) && (name == b.name) &&
+             (stats == b.stats);
+    }
+
+    bool operator!=(const row &b) const { return !(*this == b); }
+  };
+
+  /**\brief What the party rows should show
+   *
+   * Published by drawUI() on the game's thread and never changed after that,
+   * so the refresher can draw from it without touching any game objects.
+   */
+  class scene {
+  public:
+    /**\brief Counts up with every scene that's published. */
+    std::size_t version;
+
+    /**\brief How often the screen had been cleared. */
+    std::size_t epoch;
+
+    std::vector<row> rows;
+  };
+
+  /**\brief An action menu, as shown by query() */
+  class menu {
+  public:
+    /**\brief The actions the menu was built from. */
+    std::vector<std::string> actions;
+
+    /**\brief Revision of the character the menu was built for. */
+    std::optional<std::uint64_t> revision;
+
+    /**\brief Menu entries, in the order they first appear. */
+    std::vector<std::string> list;
+
+    /**\brief Submenu actions, by entry; empty if there's no submenu. */
+    std::map<std::string, std::vector<std::string>> map;
+
+    /**\brief Resource labels, by entry. */
+    std::vector<std::string> labels;
+
+    std::size_t width;
+    std::size_t llen;
+  };
+
+  /**\brief Menus by character, then by submenu path */
+  std::map<const void *, std::map<std::string, menu>> menus;
+
+  /**\brief Characters with menus, least recently used first. */
+  std::list<const void *> menuUsage;
+
+  /**\brief Rendering statistics, as collected by the refresher. */
+  statistics stats;
+
+  /**\brief Show the rendering statistics on screen? */
+  std::atomic<bool> overlay;
+
+  /**\brief When the last key press that changed the screen was read
+   *
+   * As a count of steady_clock ticks; 0 once the refresher has drawn a frame
+   * since.
+   */
+  std::atomic<std::chrono::steady_clock::rep> pressed;
+
+  /**\brief When the last key press was read; game thread only
+   *
+   * 0 once the key press changed the screen, or if it didn't and another one
+   * was read since.
+   */
+  std::chrono::steady_clock::rep typed;
+
+  /**\brief The latest scene
+   *
+   * Swapped atomically, so neither thread has to wait for the other.
+   */
+  shared<const scene> published;
+
+  /**\brief How often the screen has been cleared; game thread only. */
+  std::size_t epoch;
+
+  /**\brief Rows as of the last drawUI(); game thread only
+   *
+   * Kept around so drawing the same rows again doesn't allocate; it's only
+   * copied into a new scene if the rows changed.
+   */
+  scene draft;
+
+  /**\brief Scratch buffer for titles and captions; game thread only. */
+  std::string caption;
+
+  /**\brief How often the query area has been cleared. */
+  std::atomic<std::size_t> cleared;
+
+  /**\brief Has the game written anything since the last frame? */
+  std::atomic<bool> damaged;
+
+  /**\brief Is the refresher thread supposed to keep running? */
+  std::atomic<bool> alive;
+
+  /**\brief Changes to the animators, for the refresher thread. */
+  metaquest::ring<typename animators::command, 256> commands;
+
+  /**\brief Handles whose slots the refresher thread has freed. */
+  metaquest::ring<animator::handle, 256> released;
+
+  /**\brief Hands out handles for new animators. */
+  typename animators::reservations handles;
+
+  std::mutex wakeMutex;
+
+  /**\brief Held while writing to the screen
+   *
+   * The refresher holds it while it draws and writes out a frame, and the
+   * game while it draws into the query area or clears the screen, so they
+   * never touch the terminal's cells at the same time.
+   */
+  std::mutex screenMutex;
+
+  /**\brief Lines the game wrote to since the last frame
+   *
+   * Guarded by the screen mutex; the refresher takes them with the next
+   * frame.
+   */
+  std::vector<bool> written;
+
+  /**\brief Note lines the game wrote to
+   *
+   * Needs to be called with the screen mutex held.
+   *
+   * \param[in] line  The first line that was written to.
+   * \param[in] lines How many lines were written to.
+   */
+  void wrote(std::size_t line, std::size_t lines) {
+    written.resize(io.size()[1], false);
+
+    for (std::size_t l = line; (l < written.size()) && (l - line < lines);
+         l++) {
+      written[l] = true;
+    }
+  }
+
+  /**\brief Have commands been sent since the last frame? */
+  bool changed;
+
+  /**\brief Wakes up the refresher thread. */
+  std::condition_variable wake;
+
   std::thread refresherThread;
-  volatile bool alive;
-  std::list<animator::base<term, clock> *> active;
-  std::mutex activeMutex;
 
-  void addAnimator(animator::base<term, clock> *anim) {
-    std::lock_guard<std::mutex> lock(activeMutex);
+  /**\brief Add an animator
+   *
+   * \param[in] anim The new animator.
+   *
+   * \returns A handle to update or expire the animator with.
+   */
+  template <typename A> animator::handle addAnimator(A &&anim) {
+    using type = std::decay_t<A>;
+
+    while (const auto r = released.pop()) {
+      handles.release(*r);
+    }
+
+    typename animators::command c;
+    c.what = animators::command::add;
+    c.target = handles.reserve(animators::template index<type>());
+    c.value.emplace(std::in_place_type<type>, std::forward<A>(anim));
+
+    const animator::handle h = c.target;
+    send(std::move(c));
+
+    return h;
+  }
+
+  /**\brief Change an animator
+   *
+   * The change is applied on the refresher thread, before the next frame.
+   *
+   * \param[in] h The animator's handle.
+   * \param[in] f Called with the animator, if it's still there.
+   */
+  template <typename A, typename F>
+  void updateAnimator(const animator::handle &h, F f) {
+    if (h.type != animators::template index<A>()) {
+      return;
+    }
+
+    typename animators::command c;
+    c.what = animators::command::update;
+    c.target = h;
+    c.change = [f](animator::base<term, clock> &a) {
+      f(static_cast<A &>(a));
+    };
+
+    send(std::move(c));
+  }
+
+  /**\brief Remove an animator
+   *
+   * \param[in] h The animator's handle; does nothing if it's already gone.
+   */
+  void expireAnimator(const animator::handle &h) {
+    typename animators::command c;
+    c.what = animators::command::expire;
+    c.target = h;
+
+    send(std::move(c));
+  }
+
+  /**\brief Send a command to the refresher thread
+   *
+   * Only waits if the command queue is full, which means the refresher
+   * thread is far behind.
+   *
+   * \param[in] c The command to send.
+   */
+  void send(typename animators::command &&c) {
+    while (!commands.push(std::move(c))) {
+      wake.notify_one();
+      std::this_thread::yield();
+    }
+
+    stamp();
+
+    {
+      std::lock_guard<std::mutex> lock(wakeMutex);
+
+      changed = true;
+    }
+
+    wake.notify_one();
+  }
+
+  /**\brief Mark the screen as changed
+   *
+   * Needs to be called after writing to the screen, so the refresher knows to
+   * draw a new frame.
+   */
+  void damage(void) {
+    stamp();
+
+    {
+      std::lock_guard<std::mutex> lock(wakeMutex);
 
-    active.push_back(anim);
+      damaged = true;
+    }
+
+    wake.notify_one();
   }
 
-  void clear(void) { out.to(0, 0).clear(); }
+  void clear(void) {
+    {
+      std::lock_guard<std::mutex> lock(screenMutex);
+
+      out.to(0, 0).clear();
+      wrote(0, io.size()[1]);
+    }
+    epoch++;
+    publish(scene{0, epoch, {}});
+  }
+
+  /**\brief Publish a scene
+   *
+   * Swaps in the new scene and wakes up the refresher; the old one is freed
+   * by whichever thread lets go of it last.
+   *
+   * \param[in] s The new scene; its version is filled in.
+   */
+  void publish(scene &&s) {
+    const auto last = published.load();
+
+    s.version = last ? last->version + 1 : 1;
+    published.store(std::make_shared<scene>(std::move(s)));
+
+    damage();
+  }
 
   template <typename G>
   bool
   log(const G &game, const std::string &description,
       const metaquest::character<typename G::num> &source,
       const std::vector<metaquest::character<typename G::num> *> &targets) {
-    efgy::json::json r;
+    std::vector<metaquest::logbook::position> ts;
 
-    r.toObject();
-    r("action") = description;
-    r("source") = game.json(source);
-
-    auto &ts = r("target").toArray();
     for (const auto &t : targets) {
-      ts.push_back(game.json(*t));
+      ts.push_back({game.partyOf(*t), game.positionOf(*t)});
     }
 
-    logbook.push(r);
+    logbook.push(
+        {description, {game.partyOf(source), game.positionOf(source)}, ts});
 
     return true;
   }
@@ -401,26 +1628,91 @@ public:
     return pp + (pa == 0 ? io.size()[1] - game.parties[pa].size() : 0);
   }
 
+  /**\brief Show an action
+   *
+   * Schedules the action's animations after those of earlier actions, and
+   * returns right away; the game only waits for them before it asks the
+   * player for input.
+   */
   template <typename G>
   bool
   action(const G &game, const std::string &description,
          const metaquest::character<typename G::num> &source,
          const std::vector<metaquest::character<typename G::num> *> &targets) {
-    addAnimator(new flash(0, getLine(game, source), io.size()[0], 1));
-    addAnimator(new text(8, source.name.display() + ": " + description));
+    if (speed > 0) {
+      const auto start = std::max(clock::now(), timeline);
+      const auto hit = start + scaled(std::chrono::milliseconds(500));
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      schedule(flash(0, getLine(game, source), io.size()[0], 1), start);
+      caption.assign(source.name.display()).append(": ").append(description);
+      schedule(text(8, caption), start);
 
-    for (auto &t : targets) {
-      addAnimator(new glow(0, getLine(game, *t), io.size()[0], 1));
-    }
+      for (auto &t : targets) {
+        schedule(glow(0, getLine(game, *t), io.size()[0], 1), hit);
+      }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+      timeline = start + scaled(std::chrono::milliseconds(1500));
+    }
 
     return log(game, description, source, targets);
   }
 
+  /**\brief Add an animator to the timeline
+   *
+   * \param[in] anim  The new animator.
+   * \param[in] start When the animator should start.
+   */
+  template <typename A>
+  animator::handle schedule(A &&anim,
+                            const typename clock::time_point &start) {
+    anim.play(start, speed);
+    return addAnimator(std::forward<A>(anim));
+  }
+
+  /**\brief Scale a duration by the animation speed */
+  typename clock::duration scaled(const typename clock::duration &d) const {
+    return std::chrono::duration_cast<typename clock::duration>(d / speed);
+  }
+
+  /**\brief Wait for the timeline
+   *
+   * Waits until all scheduled animations have played, so the player sees
+   * what happened before being asked for input.
+   */
+  void settle(void) const { std::this_thread::sleep_until(timeline); }
+
+  /**\brief Read a key press
+   *
+   * Reads input like the terminal's read(), and notes the time for the input
+   * latency statistics; it only counts once the key press changes the
+   * screen, so keys that don't aren't timed against unrelated frames.
+   */
+  template <typename C, typename K> bool input(C onCommand, K onChar) {
+    const bool rv = io.read(onCommand, onChar);
+    typed = std::chrono::steady_clock::now().time_since_epoch().count();
+    return rv;
+  }
+
+  /**\brief Time the last key press
+   *
+   * Called whenever the game changes the screen; if that's the first change
+   * since a key press, the refresher measures the latency of the key press
+   * with the next frame.
+   */
+  void stamp(void) {
+    if (typed != 0) {
+      pressed = typed;
+      typed = 0;
+    }
+  }
+
+  /**\brief Draw the party rows
+   *
+   * Takes down what the rows should show and publishes it as a new scene,
+   * if that changed; the refresher draws it with the next frame.
+   */
   template <typename G> void drawUI(G &game) {
+    std::size_t n = 0;
     long in = 0, i = 0;
 
     clearQuery();
@@ -436,33 +1728,49 @@ public:
       in++;
 
       for (auto &p : party) {
-        std::ostringstream hp("");
-        std::ostringstream mp("");
-
-        hp << p["HP/Current"];
-        mp << p["MP/Current"];
-
-        out.to(0, i)
-            .clear(-1, 1)
-            .to(2, i)
-            .write(p.name.full(), 28)
-            .x(-60)
-            .write(hp.str(), 4, 1)
-            .x(-55)
-            .write(mp.str(), 4, 4)
-            .x(-50)
-            .bar2c(p["HP/Current"], p["HP/Total"], p["MP/Current"],
-                   p["MP/Total"], 50, 1, 4);
+        if (n == draft.rows.size()) {
+          draft.rows.emplace_back();
+        }
+
+        auto &r = draft.rows[n++];
+        r.line = i;
+        r.shown = true;
+        r.name.assign(p.name.full());
+        r.stats = {long(p["HP/Current"]), long(p["HP/Total"]),
+                   long(p["MP/Current"]), long(p["MP/Total"])};
         i++;
       }
     }
+
+    draft.rows.resize(n);
+    draft.epoch = epoch;
+
+    const auto last = published.load();
+    if (!last || (last->epoch != draft.epoch) || (last->rows != draft.rows)) {
+      publish(scene(draft));
+    }
   }
 
-  void clearQuery(void) { out.to(0, 8).clear(-1, 10); }
+  /**\brief Clear the query area
+   *
+   * Party rows in the area are drawn again by the refresher.
+   */
+  void clearQuery(void) {
+    {
+      std::lock_guard<std::mutex> lock(screenMutex);
+
+      out.to(0, queryLine).clear(-1, queryLines);
+      wrote(queryLine, queryLines);
+    }
+    cleared++;
+    damage();
+  }
 
   bool display(const std::string &title,
                const std::map<std::string, std::string> &data,
                std::size_t indent = 8) {
+    settle();
+
     std::size_t lhs = 0, rhs = 0;
     for (const auto &it : data) {
       lhs = std::max(lhs, it.first.size());
@@ -471,38 +1779,43 @@ public:
 
     lhs += 1;
 
-    std::size_t left = indent, top = 8,
+    std::size_t left = indent, top = queryLine,
                 width = 5 + std::max(title.size() + 4, lhs + rhs),
                 height = 3 + data.size();
 
-    out.foreground = 7;
-    out.background = 0;
+    {
+      std::lock_guard<std::mutex> lock(screenMutex);
 
-    out.to(left, top).box(width, height);
+      out.foreground = 7;
+      out.background = 0;
 
-    out.to(left + 2, top).write(": " + title + " :", title.size() + 4);
+      out.to(left, top).box(width, height);
 
-    left += 3;
-    width -= 4;
+      out.to(left + 2, top).write(": " + title + " :", title.size() + 4);
 
-    for (const auto &it : data) {
-      top++;
-      out.to(left, top).write(it.first, width);
-      out.to(left + lhs, top).write(it.second, rhs);
-    }
+      left += 3;
+      width -= 4;
+
+      for (const auto &it : data) {
+        top++;
+        out.to(left, top).write(it.first, width);
+        out.to(left + lhs, top).write(it.second, rhs);
+      }
 
-    top++;
+      top++;
 
-    out.to(left, top).write(std::string("OK"), width);
+      out.to(left, top).write(std::string("OK"), width);
+      wrote(queryLine, height);
+    }
+    damage();
 
-    auto sel = new selector(left - 2, top, width + 2, 1);
-    addAnimator(sel);
+    const auto sel = addAnimator(selector(left - 2, top, width + 2, 1));
 
     bool didCancel = false;
     bool didSelect = false;
 
     do {
-      io.read(
+      input(
           [&didSelect, &didCancel](const typename term::command &c) -> bool {
             switch (c.code) {
             case 'C': // right: select
@@ -524,104 +1837,170 @@ public:
       didSelect |= didCancel;
     } while (!didSelect);
 
-    sel->expire();
+    expireAnimator(sel);
 
     return !didCancel;
   }
 
+  /**\brief Look up a menu
+   *
+   * Builds the menu for a character's actions, or reuses the one that was
+   * built for it before if neither the actions nor the character's revision
+   * changed since. Menus are kept for up to 64 characters, and those of the
+   * least recently used character are dropped to make room. That only
+   * happens when looking up a top-level menu, so references to submenus stay
+   * valid while they're shown.
+   *
+   * \param[in] game    The game the character is in.
+   * \param[in] source  The character whose actions these are.
+   * \param[in] actions The actions, with submenus separated by '/'.
+   * \param[in] carry   The path of the submenu.
+   *
+   * \returns The menu.
+   */
   template <typename T, typename G>
-  std::string query(const G &game, const metaquest::character<T> &source,
-                    const std::vector<std::string> &pList,
-                    std::size_t indent = 4, std::string carry = "") {
-    std::size_t party = game.partyOf(source);
+  const menu &getMenu(const G &game, const metaquest::character<T> &source,
+                      const std::vector<std::string> &actions,
+                      const std::string &carry) {
+    const auto u = std::find(menuUsage.begin(), menuUsage.end(), &source);
+
+    if (u != menuUsage.end()) {
+      menuUsage.splice(menuUsage.end(), menuUsage, u);
+    } else {
+      if ((carry == "") && (menuUsage.size() >= 64)) {
+        menus.erase(menuUsage.front());
+        menuUsage.pop_front();
+      }
+      menuUsage.push_back(&source);
+    }
 
-    if (game.useAI(source)) {
-      out.to(0, 15);
-      return ai.query(game, source, pList, indent, carry);
+    menu &m = menus[&source][carry];
+    const auto revision = source.revision();
+
+    if (m.revision && (*m.revision == revision) && (m.actions == actions)) {
+      return m;
     }
 
-    std::vector<std::string> list;
-    std::map<std::string, std::vector<std::string>> map;
+    m.actions = actions;
+    m.revision = revision;
+    m.list.clear();
+    m.map.clear();
+    m.labels.clear();
 
-    for (const auto &la : pList) {
+    for (const auto &la : actions) {
       std::string l = la;
 
       const auto pos = la.find('/');
       if (pos != std::string::npos) {
         l = la.substr(0, pos);
-        map[l].push_back(la.substr(pos + 1));
       }
 
-      if (std::find(list.begin(), list.end(), l) == list.end()) {
-        list.push_back(l);
+      const auto it = m.map.find(l);
+      if (it == m.map.end()) {
+        m.list.push_back(l);
+        auto &sub = m.map[l];
+        if (pos != std::string::npos) {
+          sub.push_back(la.substr(pos + 1));
+        }
+      } else if (pos != std::string::npos) {
+        it->second.push_back(la.substr(pos + 1));
       }
     }
 
-    size_t left = indent, top = 8, width = source.name.display().size() + 9,
-           height = 2 + list.size(), llen = 0;
+    m.width = source.name.display().size() + 9;
+    m.llen = 0;
 
-    for (const auto &la : list) {
-      width = la.size() + 5 > width ? la.size() + 5 : width;
-      std::string label = game.getResourceLabel(carry + la, source);
-      llen = label.size() > llen ? label.size() : llen;
+    for (const auto &la : m.list) {
+      m.width = std::max(m.width, la.size() + 5);
+      m.labels.push_back(game.getResourceLabel(carry + la, source));
+      m.llen = std::max(m.llen, m.labels.back().size());
     }
 
-    width += llen;
+    m.width += m.llen;
 
-    out.foreground = 7;
-    out.background = 0;
+    return m;
+  }
 
-    out.to(left, top).box(width, height);
+  template <typename T, typename G>
+  std::string query(const G &game, const metaquest::character<T> &source,
+                    const std::vector<std::string> &pList,
+                    std::size_t indent = 4, std::string carry = "") {
+    std::size_t party = game.partyOf(source);
 
-    out.to(left + 2, top).write(": " + source.name.display() + " :",
-                                source.name.display().size() + 4);
+    if (game.useAI(source)) {
+      out.to(0, 15);
+      return ai.query(game, source, pList, indent, carry);
+    }
+
+    settle();
+
+    const menu &m = getMenu(game, source, pList, carry);
+    const auto &list = m.list;
+
+    size_t left = indent, top = queryLine, width = m.width,
+           height = 2 + list.size(), llen = m.llen;
 
-    for (std::size_t i = 0; i < list.size(); i++) {
-      out.to(left + 1, top + 1 + i).write("  " + list[i], width - 2);
+    {
+      std::lock_guard<std::mutex> lock(screenMutex);
 
-      std::string label = game.getResourceLabel(carry + list[i], source);
-      if (label.size() > 0) {
-        out.to(left + width - llen - 2, top + 1 + i).write(label, llen);
+      out.foreground = 7;
+      out.background = 0;
+
+      out.to(left, top).box(width, height);
+
+      caption.assign(": ").append(source.name.display()).append(" :");
+      out.to(left + 2, top).write(caption, caption.size());
+
+      for (std::size_t i = 0; i < list.size(); i++) {
+        out.to(left + 1, top + 1 + i).write("  " + list[i], width - 2);
+
+        const auto &label = m.labels[i];
+        if (label.size() > 0) {
+          out.to(left + width - llen - 2, top + 1 + i).write(label, llen);
+        }
       }
+
+      wrote(top, height);
     }
 
+    damage();
+
     long selection = 0;
     bool didSelect = false;
     bool didCancel = false;
 
-    auto sel = new selector(left + 1, top + 1, width - 2, 1);
-    auto actorHighlight =
-        new highlight(0, getLine(game, source), io.size()[0], 1);
-    addAnimator(sel);
-    addAnimator(actorHighlight);
+    const auto sel = addAnimator(selector(left + 1, top + 1, width - 2, 1));
+    const auto actorHighlight =
+        addAnimator(highlight(0, getLine(game, source), io.size()[0], 1));
 
     do {
-      sel->line = top + 1 + selection;
-
-      io.read([&selection, &didSelect, &didCancel](
-                  const typename term::command &c) -> bool {
-                switch (c.code) {
-                case 'A': // up
-                  selection--;
-                  break;
-                case 'B': // down
-                  selection++;
-                  break;
-                case 'C': // right: select
-                  didSelect = true;
-                  break;
-                case 'D': // left: cancel
-                  didCancel = true;
-                  break;
-                }
-                return false;
-              },
-              [&didSelect](const T &l) -> bool {
-                if (l == '\n') {
-                  didSelect = true;
-                }
-                return false;
-              });
+      const std::size_t line = top + 1 + selection;
+      updateAnimator<selector>(sel, [line](selector &s) { s.line = line; });
+
+      input([&selection, &didSelect, &didCancel](
+                const typename term::command &c) -> bool {
+              switch (c.code) {
+              case 'A': // up
+                selection--;
+                break;
+              case 'B': // down
+                selection++;
+                break;
+              case 'C': // right: select
+                didSelect = true;
+                break;
+              case 'D': // left: cancel
+                didCancel = true;
+                break;
+              }
+              return false;
+            },
+            [&didSelect](const T &l) -> bool {
+              if (l == '\n') {
+                didSelect = true;
+              }
+              return false;
+            });
 
       didSelect |= didCancel;
 
@@ -634,8 +2013,8 @@ public:
       }
     } while (!didSelect);
 
-    actorHighlight->expire();
-    sel->expire();
+    expireAnimator(actorHighlight);
+    expireAnimator(sel);
 
     out.to(0, 15);
 
@@ -644,10 +2023,11 @@ public:
     }
 
     const auto &sele = list[selection];
+    const auto it = m.map.find(sele);
 
-    if (map[sele].size() > 0) {
+    if (!it->second.empty()) {
       const auto sub =
-          query(game, source, map[sele], indent + 4, carry + sele + '/');
+          query(game, source, it->second, indent + 4, carry + sele + '/');
 
       if (sub == "Cancel") {
         return query(game, source, pList, indent, carry);
@@ -676,6 +2056,8 @@ public:
       return candidates;
     }
 
+    settle();
+
     std::sort(
         candidates.begin(), candidates.end(),
         [&game, this](metaquest::character<T> *a, metaquest::character<T> *b)
@@ -686,40 +2068,40 @@ public:
     bool didSelect = false;
     bool didCancel = false;
 
-    auto sel = new selector(0, 0, io.size()[0], 1);
-    addAnimator(sel);
+    const auto sel = addAnimator(selector(0, 0, io.size()[0], 1));
+
+    drawUI(game);
 
     do {
       const auto &c = *(candidates[selection]);
 
-      drawUI(game);
-
-      sel->line = getLine(game, c);
-
-      io.read([&selection, &didSelect, &didCancel](
-                  const typename term::command &c) -> bool {
-                switch (c.code) {
-                case 'A': // up
-                  selection--;
-                  break;
-                case 'B': // down
-                  selection++;
-                  break;
-                case 'C': // right: select
-                  didSelect = true;
-                  break;
-                case 'D': // left: cancel
-                  didCancel = true;
-                  break;
-                }
-                return false;
-              },
-              [&didSelect](const T &l) -> bool {
-                if (l == '\n') {
-                  didSelect = true;
-                }
-                return false;
-              });
+      const std::size_t line = getLine(game, c);
+      updateAnimator<selector>(sel, [line](selector &s) { s.line = line; });
+
+      input([&selection, &didSelect, &didCancel](
+                const typename term::command &c) -> bool {
+              switch (c.code) {
+              case 'A': // up
+                selection--;
+                break;
+              case 'B': // down
+                selection++;
+                break;
+              case 'C': // right: select
+                didSelect = true;
+                break;
+              case 'D': // left: cancel
+                didCancel = true;
+                break;
+              }
+              return false;
+            },
+            [&didSelect](const T &l) -> bool {
+              if (l == '\n') {
+                didSelect = true;
+              }
+              return false;
+            });
 
       didSelect |= didCancel;
 
@@ -732,7 +2114,7 @@ public:
       }
     } while (!didSelect);
 
-    sel->expire();
+    expireAnimator(sel);
 
     if (didCancel) {
       return std::optional<std::vector<metaquest::character<T> *>>();
@@ -744,7 +2126,10 @@ public:
 
   virtual bool load(efgy::json::json json) {
     if (json("log").isArray()) {
-      logbook = json("log");
+      logbook.load(json("log"));
+    }
+    if (json("log-start").isNumber()) {
+      logbook.rebase(json("log-start").asNumber());
     }
     return true;
   }
@@ -752,10 +2137,61 @@ public:
   virtual efgy::json::json json(void) const {
     efgy::json::json rv;
 
-    rv("log") = logbook;
+    rv("log") = logbook.json();
+    rv("log-start") = efgy::json::json::numeric(logbook.first());
+    rv("stats") = stats.json();
 
     return rv;
   }
+
+  virtual bool read(save::reader &in) {
+    std::string k;
+
+    if (!in.beginObject()) {
+      return false;
+    }
+
+    while (in.key(k)) {
+      if (k == "log") {
+        logbook.read(in);
+      } else if (k == "log-start") {
+        std::size_t start;
+        if (in.number(start)) {
+          logbook.rebase(start);
+        }
+      } else {
+        in.skip();
+      }
+    }
+
+    return in.good();
+  }
+
+  virtual void write(save::writer &out) const { write(out, logbook); }
+
+  /**\brief Saved interaction state.
+   *
+   * A copy of the logbook, which can be written out while the game goes on;
+   * this only has the entries that are kept in memory.
+   */
+  class snapshot {
+  public:
+    metaquest::logbook log;
+
+    void write(save::writer &out) const { base::write(out, log); }
+  };
+
+  snapshot capture(void) const { return {logbook}; }
+
+protected:
+  static void write(save::writer &out, const metaquest::logbook &log) {
+    out.beginObject();
+    out.key("log");
+    log.write(out);
+    out.key("log-start");
+    out.number(log.first());
+    out.end();
+  }
 };
 }
 }
@@ -0,0 +1,49 @@
+/**\file
+ * \brief UTF-8
+ *
+ * Encodes code points as UTF-8, for everything that turns cell contents or
+ * escaped characters into bytes: the frame encoder, the in-memory terminal and
+ * the JSON reader.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#if !defined(METAQUEST_UTF8_H)
+#define METAQUEST_UTF8_H
+
+#include <string>
+
+namespace metaquest {
+namespace utf8 {
+/**\brief Append a code point
+ *
+ * \param[out] s Where to append the encoded code point.
+ * \param[in]  c The code point; needs to be below 0x110000.
+ */
+static void append(std::string &s, unsigned long c) {
+  if (c < 0x80) {
+    s.push_back(char(c));
+  } else if (c < 0x800) {
+    s.push_back(char(0xc0 | (c >> 6)));
+    s.push_back(char(0x80 | (c & 0x3f)));
+  } else if (c < 0x10000) {
+    s.push_back(char(0xe0 | (c >> 12)));
+    s.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+    s.push_back(char(0x80 | (c & 0x3f)));
+  } else {
+    s.push_back(char(0xf0 | (c >> 18)));
+    s.push_back(char(0x80 | ((c >> 12) & 0x3f)));
+    s.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+    s.push_back(char(0x80 | (c & 0x3f)));
+  }
+}
+}
+}
+
+#endif
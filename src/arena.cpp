@@ -18,14 +18,20 @@
  * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
  */
 
-#include <fstream>
-#include <sstream>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
 
 #include <metaquest/terminal.h>
+#include <metaquest/terminal-memory.h>
 #include <metaquest/party.h>
 #include <metaquest/rules-simple.h>
 #include <metaquest/flow-generic.h>
-#include <ef.gy/stream-json.h>
+#include <metaquest/mapping.h>
+#include <metaquest/save-binary.h>
+#include <metaquest/save-json.h>
+#include <metaquest/journal.h>
 #include <ef.gy/cli.h>
 
 using namespace efgy;
@@ -33,6 +39,246 @@ using namespace efgy;
 static cli::flag<std::string> saveFile("save-file",
                                        "where to store/load game data to/from");
 
+static cli::flag<std::string>
+    saveFormat("save-format",
+               "format for the save file: 'json' or 'binary'; defaults to "
+               "the format it was loaded in");
+
+static cli::flag<std::string>
+    autosaveInterval("autosave",
+                     "seconds between incremental autosaves to the save "
+                     "file's journal; defaults to 60, 0 turns autosaving off");
+
+static cli::flag<std::string>
+    nameData("name-data", "directory with binary name models to use");
+
+static cli::flag<std::string>
+    animationSpeed("speed",
+                   "how fast to play animations: 1 for normal speed, 2 for "
+                   "twice as fast and so on; 0 turns animations off");
+
+static cli::flag<bool>
+    debugOverlay("debug-overlay",
+                 "show frame times and input latency in the top right corner");
+
+static cli::flag<std::string>
+    terminalType("terminal",
+                 "'console' to play on the terminal, the default, or 'memory' "
+                 "to play headlessly and print rendering statistics, e.g. to "
+                 "benchmark");
+
+static cli::flag<std::string>
+    keyPresses("keys",
+               "with --terminal=memory: how many keys to press before "
+               "quitting; defaults to 1000");
+
+#if defined(METAQUEST_COUNT_ALLOCATIONS)
+/**\brief Count heap allocations on this thread? */
+static thread_local bool counting = false;
+
+/**\brief Heap allocations counted on this thread so far
+ *
+ * Only counted in benchmark builds - see the 'arena-bench' target - for the
+ * statistics of --terminal=memory, and only on the game's thread while it
+ * plays, so the refresher and autosave threads don't show up.
+ */
+static thread_local std::size_t allocations = 0;
+
+void *operator new(std::size_t size) {
+  if (counting) {
+    allocations++;
+  }
+
+  if (void *p = std::malloc(size > 0 ? size : 1)) {
+    return p;
+  }
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#else
+static const bool counting = false;
+static const std::size_t allocations = 0;
+#endif
+
+/**\brief Is the key budget used up?
+ *
+ * Terminals only run out of keys when they're scripted.
+ *
+ * \returns 'false'.
+ */
+template <typename T> static bool exhausted(const T &, std::size_t) {
+  return false;
+}
+
+template <typename T>
+static bool exhausted(const metaquest::interact::terminal::memory<T> &io,
+                      std::size_t keys) {
+  return io.keys >= keys;
+}
+
+/**\brief Print rendering statistics
+ *
+ * Only the in-memory terminal has any to print.
+ */
+template <typename T> static void report(const T &, std::size_t) {}
+
+template <typename T>
+static void report(const metaquest::interact::terminal::memory<T> &io,
+                   std::size_t allocated) {
+  const std::size_t keys = io.keys;
+
+  std::cout << "frames: " << io.frames << "\n"
+            << "cells: " << io.cells << "\n"
+            << "bytes: " << io.bytes << "\n"
+            << "keys: " << keys << "\n";
+
+  if (counting) {
+    std::cout << "allocations: " << allocated << "\n"
+              << "allocations per key press: "
+              << (keys > 0 ? double(allocated) / double(keys) : 0.) << "\n";
+  }
+}
+
+/**\brief Play the game
+ *
+ * Loads the save file if there is one, plays until the game is over and
+ * saves the game again.
+ *
+ * \tparam term The terminal type to play on.
+ *
+ * \param[in] file    The save file; empty to play without one.
+ * \param[in] format  The save format; empty for the one the save is in.
+ * \param[in] seconds Seconds between autosaves; 0 turns them off.
+ * \param[in] factor  Animation speed.
+ * \param[in] keys    How many scripted keys to press before quitting.
+ *
+ * \returns 0 on success, something else otherwise.
+ */
+template <typename term>
+static int play(const std::string &file, std::string format, long seconds,
+                double factor, std::size_t keys) {
+  using interaction = metaquest::interact::terminal::base<term>;
+
+  metaquest::flow::generic<interaction,
+                           metaquest::rules::simple::game<interaction>> game;
+
+  game.interact.speed = factor;
+  game.interact.overlay = bool(debugOverlay);
+
+  bool loaded = false;
+
+  if (file != "") {
+    metaquest::mapping save(file);
+
+    if (metaquest::save::binary::reader::is(save.data, save.size)) {
+      metaquest::save::binary::reader in(save.data, save.size);
+
+      if (!game.read(in)) {
+        std::cerr << "could not read save file " << file << "\n";
+        return 1;
+      }
+
+      loaded = true;
+
+      if (format == "") {
+        format = "binary";
+      }
+    } else if (save.valid()) {
+      metaquest::save::json::reader in(save.data, save.size);
+
+      if (!game.read(in)) {
+        std::cerr << "could not read save file " << file << "\n";
+        return 1;
+      }
+
+      loaded = true;
+
+      if (format == "") {
+        format = "json";
+      }
+    }
+  }
+
+  using journal = metaquest::save::journal<decltype(game)>;
+  using autosave = metaquest::save::autosave<typename journal::update>;
+  std::unique_ptr<journal> changes;
+  std::unique_ptr<autosave> saver;
+
+  if (file != "") {
+    game.interact.logbook.archive(file + ".log");
+    changes.reset(new journal(file, format));
+    changes->replay(game, loaded);
+  }
+
+  if ((file != "") && (seconds > 0)) {
+    saver.reset(new autosave(
+        [&changes](const typename journal::update &u) {
+          return changes->commit(u);
+        },
+        std::chrono::seconds(seconds), true));
+  }
+
+  bool warned = false;
+
+  game.checkpoint = [&changes, &saver, &warned, &file,
+                     keys](decltype(game) &g) {
+    if (exhausted(g.interact.io, keys)) {
+      g.game.end();
+    }
+
+    if (saver && saver->due()) {
+      auto u = changes->capture(g);
+      if (!u.empty()) {
+        saver->offer(std::move(u));
+      }
+    }
+
+    if (saver && saver->error() && !warned) {
+      warned = true;
+      g.interact.log("Autosave to " + file + " failed; progress is not "
+                     "being saved");
+    }
+  };
+
+#if defined(METAQUEST_COUNT_ALLOCATIONS)
+  counting = true;
+#endif
+  const std::size_t before = allocations;
+
+  game.run();
+
+  const std::size_t allocated = allocations - before;
+  report(game.interact.io, allocated);
+#if defined(METAQUEST_COUNT_ALLOCATIONS)
+  counting = false;
+#endif
+
+  game.checkpoint = nullptr;
+
+  if (saver) {
+    saver->finish();
+
+    if (saver->error()) {
+      std::cerr << "could not autosave to " << file << "\n";
+    }
+
+    saver.reset();
+  }
+
+  if (file != "") {
+    if (!changes->commit(changes->capture(game, true))) {
+      std::cerr << "could not write save file " << file << "\n";
+    }
+  }
+
+  return 0;
+}
+
+
 /**\brief Metaquest: Arena main function
  *
  * This is the main function for the 'arena' programme. It is currently far from
@@ -44,35 +290,52 @@ int main(int argc, char **argv) {
   int rv = cli::options<>::common().apply(argc, argv);
 
   const std::string file = saveFile;
-  efgy::json::value<> json;
-
-  {
-    metaquest::flow::generic<metaquest::interact::terminal::base<>,
-                             metaquest::rules::simple::game<
-                                 metaquest::interact::terminal::base<>>> game;
-
-    if (file != "") {
-      std::ifstream save(file);
-      std::istreambuf_iterator<char> eos;
-      std::string s(std::istreambuf_iterator<char>(save), eos);
+  const std::string names = nameData;
+  std::string format = saveFormat;
+  const std::string interval = autosaveInterval;
+  const long seconds =
+      interval == "" ? 60 : std::strtol(interval.c_str(), nullptr, 10);
+  const std::string speed = animationSpeed;
+  const double factor =
+      speed == "" ? 1 : std::strtod(speed.c_str(), nullptr);
+  const std::string backend = terminalType;
+  const std::string presses = keyPresses;
+  const long keys =
+      presses == "" ? 1000 : std::strtol(presses.c_str(), nullptr, 10);
 
-      s >> json;
+  if (factor < 0) {
+    std::cerr << "invalid animation speed: " << speed << "\n";
+    return 1;
+  }
 
-      game.load(json);
-    }
+  if ((format != "") && (format != "json") && (format != "binary")) {
+    std::cerr << "unknown save format: " << format << "\n";
+    return 1;
+  }
 
-    game.run();
+  if ((backend != "") && (backend != "console") && (backend != "memory")) {
+    std::cerr << "unknown terminal: " << backend << "\n";
+    return 1;
+  }
 
-    json = game.json();
+  if (keys < 0) {
+    std::cerr << "invalid number of keys: " << presses << "\n";
+    return 1;
   }
 
-  if (file != "") {
-    std::ofstream save(file);
-    std::ostringstream oss("");
+  if (names != "") {
+    if (!metaquest::name::american::dataset::select(
+            metaquest::name::american::dataset::load(names))) {
+      std::cerr << "could not load name models from " << names << "\n";
+      return 1;
+    }
+  }
 
-    oss << efgy::json::tag() << json;
-    save << oss.str();
+  if (backend == "memory") {
+    return play<metaquest::interact::terminal::memory<>>(file, format, seconds,
+                                                        factor, keys);
   }
 
-  return 0;
+  return play<metaquest::interact::terminal::console<>>(file, format, seconds,
+                                                       factor, keys);
 }
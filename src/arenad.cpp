@@ -18,32 +18,371 @@
  * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
  */
 
-#define ASIO_DISABLE_THREADS
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <sstream>
+#include <thread>
+#include <vector>
 
-#include <metaquest/terminal.h>
+#include <metaquest/fiber.h>
+#include <metaquest/remote.h>
 #include <metaquest/party.h>
 #include <metaquest/rules-simple.h>
 #include <metaquest/flow-generic.h>
 
+#include <ef.gy/cli.h>
 #include <ef.gy/stream-json.h>
 #include <ef.gy/httpd.h>
 
 using namespace efgy;
 
-static const char *arenaRx = "/arena";
+static cli::flag<std::string>
+    threadCount("threads", "how many threads to serve requests on; defaults "
+                           "to one per CPU core");
 
+static cli::flag<std::string>
+    battleLimit("battles", "how many battles to host at most; new ones are "
+                           "turned away past that; defaults to 65536");
+
+using interaction = metaquest::interact::remote::base<>;
+
+/**\brief A hosted battle
+ *
+ * Each battle runs on a fiber rather than a thread: it plays until it asks the
+ * player a question, then hands back control until the answer comes in. The
+ * game is only ever resumed or looked at on the battle's strand, so requests
+ * for the same battle take turns, and those for different battles don't wait
+ * for each other.
+ */
+class battle {
+public:
+  using clock = std::chrono::steady_clock;
+
+  battle(asio::io_service &service)
+      : touched(clock::now().time_since_epoch().count()), strand(service),
+        play([this] {
+          game.run();
+          game.interact.finish();
+        }) {
+    game.interact.yield = [this] { play.yield(); };
+  }
+
+  /**\brief Destructor
+   *
+   * Closes the game, which then quits at its next question, and plays it out
+   * so everything on the fiber's stack is cleaned up.
+   */
+  ~battle(void) {
+    game.interact.close();
+
+    while (play.resume()) {
+    }
+  }
+
+  metaquest::flow::generic<interaction,
+                           metaquest::rules::simple::game<interaction>>
+      game;
+
+  /**\brief When the player last asked about the battle, in clock ticks. */
+  std::atomic<clock::rep> touched;
+
+  asio::io_service::strand strand;
+
+  metaquest::fiber play;
+};
+
+/**\brief Hosted battles
+ *
+ * Battles are spread over shards by ID, each with a lock of its own, so
+ * requests for different battles hardly ever wait for each other. Locks are
+ * only held to look up, add or remove a battle, never while one is played.
+ *
+ * Ending a battle means playing it out, so that's left to a thread of its
+ * own: whoever lets go of a battle last hands it over, and the request
+ * threads never spend time on it. The same thread drops battles that nobody
+ * has asked about for a while.
+ */
+class battles {
+public:
+  static const std::size_t shards = 64;
+
+  battles(void) : limit(65536), live(0), running(true), janitor([this] {
+                    tend();
+                  }) {}
+
+  ~battles(void) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      running = false;
+    }
+    retired.notify_one();
+    janitor.join();
+
+    for (auto &s : shard) {
+      s.table.clear();
+    }
+
+    for (auto b : dead) {
+      delete b;
+    }
+  }
+
+  /**\brief Most battles to host at once. */
+  std::atomic<std::size_t> limit;
+
+  /**\brief Start a battle
+   *
+   * \param[out] id The new battle's ID.
+   *
+   * \returns The new battle; a null pointer if there are too many already.
+   */
+  std::shared_ptr<battle> create(std::uint64_t &id) {
+    // IDs are random, so they can't be guessed, and have 53 bits at most,
+    // so they survive being a JSON number
+    thread_local std::mt19937_64 rng(std::random_device{}());
+
+    if (live.fetch_add(1) >= limit) {
+      live--;
+      return nullptr;
+    }
+
+    const std::shared_ptr<battle> b(new battle(io::service::common().get()),
+                                    [this](battle *d) { retire(d); });
+
+    do {
+      id = rng() >> 11;
+    } while (!insert(id, b));
+
+    return b;
+  }
+
+  /**\brief Look up a battle
+   *
+   * \param[in] id The battle's ID.
+   *
+   * \returns The battle, if there is one with that ID.
+   */
+  std::shared_ptr<battle> find(std::uint64_t id) {
+    auto &s = shard[id % shards];
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    const auto it = s.table.find(id);
+    if (it == s.table.end()) {
+      return nullptr;
+    }
+
+    it->second->touched = battle::clock::now().time_since_epoch().count();
+    return it->second;
+  }
+
+  void remove(std::uint64_t id) {
+    std::shared_ptr<battle> b;
+    auto &s = shard[id % shards];
+
+    {
+      std::lock_guard<std::mutex> lock(s.mutex);
+
+      const auto it = s.table.find(id);
+      if (it != s.table.end()) {
+        b = it->second;
+        s.table.erase(it);
+      }
+    }
+
+    // if this was the last reference, the battle is handed to the janitor
+    // here, after the lock has been released
+  }
+
+protected:
+  /**\brief How long a battle is kept without anyone asking about it. */
+  static constexpr std::chrono::minutes idle{10};
+
+  /**\brief How often to look for battles that have been idle too long. */
+  static constexpr std::chrono::minutes sweep{1};
+
+  class part {
+  public:
+    std::mutex mutex;
+    std::map<std::uint64_t, std::shared_ptr<battle>> table;
+  };
+
+  std::array<part, shards> shard;
+
+  /**\brief Battles that have been started and not ended yet. */
+  std::atomic<std::size_t> live;
+
+  /**\brief Guards 'dead' and 'running'. */
+  std::mutex mutex;
+
+  /**\brief Signalled when a battle is handed over, or on shutdown. */
+  std::condition_variable retired;
+
+  /**\brief Battles that nobody refers to anymore, to be ended. */
+  std::vector<battle *> dead;
+
+  bool running;
+
+  std::thread janitor;
+
+  bool insert(std::uint64_t id, const std::shared_ptr<battle> &b) {
+    auto &s = shard[id % shards];
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    return s.table.emplace(id, b).second;
+  }
+
+  /**\brief Hand over a battle to be ended
+   *
+   * Deleter for the battles' shared pointers; may be called on any thread.
+   *
+   * \param[in] b The battle, which nobody refers to anymore.
+   */
+  void retire(battle *b) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      dead.push_back(b);
+    }
+
+    retired.notify_one();
+  }
+
+  /**\brief Drop idle battles
+   *
+   * \param[in] cutoff Battles that nobody asked about since are dropped.
+   */
+  void expire(const battle::clock::time_point &cutoff) {
+    for (auto &s : shard) {
+      std::vector<std::shared_ptr<battle>> stale;
+
+      {
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        for (auto it = s.table.begin(); it != s.table.end();) {
+          if (it->second->touched < cutoff.time_since_epoch().count()) {
+            stale.push_back(it->second);
+            it = s.table.erase(it);
+          } else {
+            it++;
+          }
+        }
+      }
+
+      // handed over here, with the shard unlocked
+    }
+  }
+
+  /**\brief Janitor thread
+   *
+   * Ends battles as they're handed over, and drops idle battles every so
+   * often, until the battles are shut down.
+   */
+  void tend(void) {
+    auto next = battle::clock::now() + sweep;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (running) {
+      retired.wait_until(lock, next,
+                         [this] { return !running || !dead.empty(); });
+
+      std::vector<battle *> ending;
+      ending.swap(dead);
+
+      lock.unlock();
+
+      for (auto b : ending) {
+        delete b;
+        live--;
+      }
+
+      const auto now = battle::clock::now();
+      if (!(now < next)) {
+        expire(now - idle);
+        next = now + sweep;
+      }
+
+      lock.lock();
+    }
+  }
+};
+
+static battles arenas;
+
+static const char *arenaRx = "/arena(/([0-9]+)(/([0-9]+)/([0-9]+))?)?";
+
+/**\brief Play a battle
+ *
+ * '/arena' starts a new battle, '/arena/<id>' shows a battle and
+ * '/arena/<id>/<question>/<option>' answers its current question; all of them
+ * reply with the battle's state. Starting a battle or answering a question
+ * plays the battle up to its next question on the battle's strand, and the
+ * reply is sent from there; the request's own thread never waits for it.
+ */
 template <class transport>
 static bool arena(typename net::http::server<transport>::session &session,
-                  std::smatch &) {
-  efgy::json::value<> json;
-  std::ostringstream oss("");
+                  std::smatch &m) {
+  std::uint64_t id;
+  std::shared_ptr<battle> b;
+
+  if (m[2].matched) {
+    id = std::strtoull(m[2].str().c_str(), nullptr, 10);
+    b = arenas.find(id);
+
+    if (!b) {
+      session.reply(404, "no such battle");
+      return true;
+    }
+  } else {
+    b = arenas.create(id);
+
+    if (!b) {
+      session.reply(503, "too many battles");
+      return true;
+    }
+  }
+
+  const bool answering = m[3].matched;
+  const bool playing = !m[2].matched || answering;
+  const std::size_t question =
+      answering ? std::strtoull(m[4].str().c_str(), nullptr, 10) : 0;
+  const std::size_t option =
+      answering ? std::strtoull(m[5].str().c_str(), nullptr, 10) : 0;
+  auto *s = &session;
+
+  b->strand.post([b, s, id, answering, playing, question, option] {
+    auto &interact = b->game.interact;
 
-  // do game things here
+    if (answering && !interact.answer(question, option)) {
+      s->reply(409, "no such question or option");
+      return;
+    }
 
-  oss << efgy::json::tag() << json;
+    if (playing) {
+      b->play.resume();
+    }
+
+    efgy::json::json json = interact.status();
+    json("id") = efgy::json::json::numeric(id);
+
+    if (interact.finished()) {
+      arenas.remove(id);
+    }
+
+    std::ostringstream oss("");
+    oss << efgy::json::tag() << json;
+
+    s->reply(200, oss.str());
+  });
 
-  session.reply(200, oss.str());
   return true;
 }
 
@@ -60,4 +399,40 @@ static httpd::servlet<stream_protocol> quit("/quit",
                                             httpd::quit<stream_protocol>);
 }
 
-int main(int argc, char *argv[]) { return io::main(argc, argv); }
+/**\brief Metaquest: Arena daemon main function
+ *
+ * Sets up the servers given on the command line, then serves requests on a
+ * pool of threads until told to quit.
+ *
+ * \returns 0 on success, something else otherwise.
+ */
+int main(int argc, char *argv[]) {
+  int rv = cli::options<>::common().apply(argc, argv);
+
+  const std::string count = threadCount;
+  long threads = count == "" ? long(std::thread::hardware_concurrency())
+                             : std::strtol(count.c_str(), nullptr, 10);
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  const std::string limit = battleLimit;
+  if (limit != "") {
+    arenas.limit = std::strtoul(limit.c_str(), nullptr, 10);
+  }
+
+  auto &service = io::service::common().get();
+  std::vector<std::thread> pool;
+
+  for (long i = 1; i < threads; i++) {
+    pool.emplace_back([&service] { service.run(); });
+  }
+
+  service.run();
+
+  for (auto &t : pool) {
+    t.join();
+  }
+
+  return rv;
+}
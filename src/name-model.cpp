@@ -0,0 +1,60 @@
+/**\file
+ * \brief Metaquest: Name model compiler
+ *
+ * This is the 'name-model' programme of the metaquest project. It reads census
+ * name data on stdin, trains a Markov chain on it and writes the flattened
+ * chain to stdout, either as a header or as a binary model that can be
+ * memory-mapped at runtime. The makefile uses this to compile the name models,
+ * so that names can be generated without a training pass at runtime.
+ *
+ * \copyright
+ * This file is part of the Metaquest project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Documentation: https://ef.gy/documentation/metaquest
+ * \see Source Code: https://github.com/jyujin/metaquest
+ * \see Licence Terms: https://github.com/jyujin/metaquest/COPYING
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <metaquest/markov.h>
+
+/**\brief Metaquest: Name model compiler main function
+ *
+ * Expects the identifier of the model as its first argument, or '--binary' to
+ * write a binary model, and optionally the maximum number of lines of census
+ * data to use as its second.
+ *
+ * \returns 0 on success, something else otherwise.
+ */
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <identifier|--binary> [lines]\n";
+    return 1;
+  }
+
+  const std::string id = argv[1];
+  const long lines = argc > 2 ? std::stol(argv[2]) : 5000;
+
+  metaquest::markov::trainer trainer;
+  std::string line;
+
+  for (long l = 0; (l < lines) && std::getline(std::cin, line); l++) {
+    std::istringstream is(line);
+    std::string name;
+    double frequency;
+
+    if (is >> name >> frequency) {
+      trainer.add(name, frequency * 1000 + 1);
+    }
+  }
+
+  if (id == "--binary") {
+    return trainer.write(std::cout) ? 0 : 1;
+  }
+
+  return trainer.write(std::cout, id) ? 0 : 1;
+}